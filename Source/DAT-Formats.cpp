@@ -15,16 +15,20 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
-#include <windows.h>
 #include <stdio.h>
-#include <tchar.h>
 #include <stdlib.h>
+#include "Platform.h"
+#include "Misc.h"
 #include "Vars.h"
 #include "DAT.h"
 #include "DAT-Formats.h"
-#include "Misc.h"
+#include "Pipeline.h"
+#include "ImageWriters.h"
+#include "Unpack.h"
+#include "ImageCache.h"
+#include "Palette.h"
 
-//TODO: We should make it possible to specify offset for palette when calling Prince_ConvertPaletteToGeneric() - This would make it possible to access different parts of the guards palette from POP1 assets
+static bool allPaletteVariants = 0;
 
 #pragma pack(push, 1)
 struct imgHeader_s
@@ -54,15 +58,14 @@ struct paletteV2_s //POP2 (shape palette)
 struct pop2_frame_type_exactSize {
 	short image;
 	short sword;
-	char dx;
-	char dy;
+	signed char dx; //Plain char is unsigned on some platforms
+	signed char dy;
 	unsigned char flags;
 };
 #pragma pack(pop)
 
-void Prince_ConvertPaletteToGeneric(princeGenericPalette_s *genericPal, unsigned char *sourcePal, unsigned int sourcePalSize, int sourcePalType)
+static void ConvertPaletteColours(princeColour_s *colours, const unsigned char *sourcePal, unsigned int sourcePalSize, int sourcePalType)
 {
-	memset(genericPal, 0, sizeof(princeGenericPalette_s));
 	if(sourcePalType == POP1_DATFORMAT_PAL)
 	{
 		if(sourcePalSize != sizeof(palette_s))
@@ -72,18 +75,23 @@ void Prince_ConvertPaletteToGeneric(princeGenericPalette_s *genericPal, unsigned
 		}
 		for(int colourNum = 0, k = 0; k < 48; k += 3, colourNum++)
 		{
-			genericPal->colours[colourNum].r = ((palette_s *) sourcePal)->vgaPal[k + 0] << 2;
-			genericPal->colours[colourNum].g = ((palette_s *) sourcePal)->vgaPal[k + 1] << 2;
-			genericPal->colours[colourNum].b = ((palette_s *) sourcePal)->vgaPal[k + 2] << 2;
+			colours[colourNum].r = ((const palette_s *) sourcePal)->vgaPal[k + 0] << 2;
+			colours[colourNum].g = ((const palette_s *) sourcePal)->vgaPal[k + 1] << 2;
+			colours[colourNum].b = ((const palette_s *) sourcePal)->vgaPal[k + 2] << 2;
 		}
 	}
 	else if(sourcePalType == POP2_DATFORMAT_SHAPE_PALETTE)
 	{
+		if(sourcePalSize < sizeof(paletteV2_s))
+		{
+			StatusUpdate("Warning: Input palette is too small to be a POP2 shape palette.");
+			return;
+		}
 		for(int colourNum = 0, k = 0; k < 48; k += 3, colourNum++)
 		{
-			genericPal->colours[colourNum].r = ((paletteV2_s *) sourcePal)->vgaPal[k + 0] << 2;
-			genericPal->colours[colourNum].g = ((paletteV2_s *) sourcePal)->vgaPal[k + 1] << 2;
-			genericPal->colours[colourNum].b = ((paletteV2_s *) sourcePal)->vgaPal[k + 2] << 2;
+			colours[colourNum].r = ((const paletteV2_s *) sourcePal)->vgaPal[k + 0] << 2;
+			colours[colourNum].g = ((const paletteV2_s *) sourcePal)->vgaPal[k + 1] << 2;
+			colours[colourNum].b = ((const paletteV2_s *) sourcePal)->vgaPal[k + 2] << 2;
 		}
 	}
 	else if(sourcePalType == POP2_DATFORMAT_SVGA_PALETTE || sourcePalType == POP2_DATFORMAT_TGA_PALETTE || sourcePalType == POP1_DATFORMAT_MULTIPAL)
@@ -93,16 +101,40 @@ void Prince_ConvertPaletteToGeneric(princeGenericPalette_s *genericPal, unsigned
 			StatusUpdate("Warning: Input POP2 SVGA palette size is too big.");
 			return;
 		}
-		for(unsigned int colourNum = 0, k = 0; k < sourcePalSize; k += 3, colourNum++)
+		for(unsigned int colourNum = 0, k = 0; k + 3 <= sourcePalSize; k += 3, colourNum++) //Leftover bytes that don't make up a whole colour are ignored
 		{
-			genericPal->colours[colourNum].r = sourcePal[k + 0] << 2;
-			genericPal->colours[colourNum].g = sourcePal[k + 1] << 2;
-			genericPal->colours[colourNum].b = sourcePal[k + 2] << 2;
+			colours[colourNum].r = sourcePal[k + 0] << 2;
+			colours[colourNum].g = sourcePal[k + 1] << 2;
+			colours[colourNum].b = sourcePal[k + 2] << 2;
 		}
 	}
 }
 
-int Prince_GuessDATFormat(unsigned char *data, unsigned int dataSize, bool isPalLoaded) //This is only done for POP1 assets
+static void BuildPaletteLookup(unsigned int *lookup, const princeColour_s *colours)
+{
+	for(int i = 0; i < 256; i++)
+	{
+		unsigned char rgba[4] = {colours[i].r, colours[i].g, colours[i].b, (unsigned char) (i == 0 ? 0 : 255)}; //First palette entry is transparent entry
+		memcpy(&lookup[i], rgba, 4);
+	}
+}
+
+const princePalette_s *Prince_ConvertPalette(const unsigned char *sourcePal, unsigned int sourcePalSize, int sourcePalType, unsigned int sourcePalOffset)
+{
+	princeColour_s colours[PRINCEMAXPALSIZE];
+	memset(colours, 0, sizeof(colours));
+	if(sourcePalOffset > sourcePalSize)
+	{
+		StatusUpdate("Warning: Palette offset %u is past the end of the %u byte palette.", sourcePalOffset, sourcePalSize);
+		sourcePalOffset = sourcePalSize;
+	}
+	ConvertPaletteColours(colours, &sourcePal[sourcePalOffset], sourcePalSize - sourcePalOffset, sourcePalType);
+	unsigned int lookup[256];
+	BuildPaletteLookup(lookup, colours);
+	return Prince_CompilePalette(lookup);
+}
+
+int Prince_GuessDATFormat(const unsigned char *data, unsigned int dataSize, bool isPalLoaded) //This is only done for POP1 assets
 {
 	int format = -1;
 	bool possiblyPAL = 0, possiblyIMG = 0;
@@ -111,7 +143,7 @@ int Prince_GuessDATFormat(unsigned char *data, unsigned int dataSize, bool isPal
 	if(dataSize == sizeof(palette_s))
 	{
 		//Check if every part of the VGA palette is 6 bits in size
-		palette_s *pal = (palette_s *) data;
+		const palette_s *pal = (const palette_s *) data;
 		possiblyPAL = 1;
 		bool invalid = 0;
 		for(int i = 0; i < 48; i++)
@@ -127,7 +159,7 @@ int Prince_GuessDATFormat(unsigned char *data, unsigned int dataSize, bool isPal
 	//Check if it's an image
 	if(isPalLoaded && dataSize > sizeof(imgHeader_s))
 	{
-		imgHeader_s *imgHeader = (imgHeader_s *) data;
+		const imgHeader_s *imgHeader = (const imgHeader_s *) data;
 		possiblyIMG = 1;
 		if(imgHeader->height > 2048 || imgHeader->width > 2048 //Arbitrary limit
 			|| imgHeader->height == 0 || imgHeader->width == 0
@@ -147,220 +179,195 @@ int Prince_GuessDATFormat(unsigned char *data, unsigned int dataSize, bool isPal
 	return POP1_DATFORMAT_BIN;
 }
 
-//Based on SDL-PoP code
-void decompress_rle_lr(byte* destination,const byte* source,int dest_length) {
-	const byte* src_pos = source;
-	byte* dest_pos = destination;
-	short rem_length = dest_length;
-	while (rem_length) {
-		signed char count = *src_pos;
-		src_pos++;
-		if (count >= 0) { // copy
-			++count;
-			do {
-				*dest_pos = *src_pos;
-				dest_pos++;
-				src_pos++;
-				--rem_length;
-				--count;
-			} while (count && rem_length);
-		} else { // repeat
-			byte al = *src_pos;
-			src_pos++;
-			count = -count;
-			do {
-				*dest_pos = al;
-				dest_pos++;
-				--rem_length;
-				--count;
-			} while (count && rem_length);
-		}
-	}
+struct rleReader_s //Decodes left-to-right RLE data in pieces, so we can decode one row at a time
+{
+	const unsigned char *src;
+	const unsigned char *srcEnd; //Everything after the end of the data is read as zeros
+	int count; //Bytes left of the current run
+	bool repeat; //Current run repeats value instead of copying from src
+	unsigned char value;
+};
+
+static void InitRLEReader(rleReader_s *reader, const unsigned char *source, unsigned int sourceSize)
+{
+	reader->src = source;
+	reader->srcEnd = source + sourceSize;
+	reader->count = 0;
+	reader->repeat = 0;
+	reader->value = 0;
 }
 
 //Based on SDL-PoP code
-void decompress_rle_ud(byte* destination,const byte* source,int dest_length,int width,int height) {
-	short rem_height = height;
-	const byte* src_pos = source;
-	byte* dest_pos = destination;
-	short rem_length = dest_length;
-	--dest_length;
-	--width;
-	while (rem_length) {
-		signed char count = *src_pos;
-		src_pos++;
-		if (count >= 0) { // copy
-			++count;
-			do {
-				*dest_pos = *src_pos;
-				dest_pos++;
-				src_pos++;
-				dest_pos += width;
-				--rem_height;
-				if (rem_height == 0) {
-					dest_pos -= dest_length;
-					rem_height = height;
-				}
-				--rem_length;
-				--count;
-			} while (count && rem_length);
-		} else { // repeat
-			byte al = *src_pos;
-			src_pos++;
-			count = -count;
-			do {
-				*dest_pos = al;
-				dest_pos++;
-				dest_pos += width;
-				--rem_height;
-				if (rem_height == 0) {
-					dest_pos -= dest_length;
-					rem_height = height;
-				}
-				--rem_length;
-				--count;
-			} while (count && rem_length);
+static void ReadRLE(rleReader_s *reader, unsigned char *dest, int length)
+{
+	while(length)
+	{
+		if(reader->count == 0)
+		{
+			if(reader->srcEnd - reader->src < 2) //Not enough left for another run
+			{
+				reader->src = reader->srcEnd;
+				memset(dest, 0, length);
+				return;
+			}
+			signed char count = *reader->src;
+			reader->src++;
+			if(count >= 0) //Copy
+			{
+				reader->count = count + 1;
+				reader->repeat = 0;
+			}
+			else //Repeat
+			{
+				reader->count = -count;
+				reader->repeat = 1;
+				reader->value = *reader->src;
+				reader->src++;
+			}
+		}
+		int runLength = reader->count < length ? reader->count : length;
+		if(reader->repeat)
+			memset(dest, reader->value, runLength);
+		else
+		{
+			if(runLength > reader->srcEnd - reader->src)
+				runLength = reader->count = (int) (reader->srcEnd - reader->src);
+			memcpy(dest, reader->src, runLength);
+			reader->src += runLength;
 		}
+		dest += runLength;
+		length -= runLength;
+		reader->count -= runLength;
 	}
 }
 
-//Based on SDL-PoP code
-byte* decompress_lzg_lr(byte* dest,const byte* source,int dest_length) {
-	byte* window = (byte*) malloc(0x400);
-	if (window == NULL) return NULL;
-	memset(window, 0, 0x400);
-	byte* window_pos = window + 0x400 - 0x42; // bx
-	short remaining = dest_length; // cx
-	byte* window_end = window + 0x400; // dx
-	const byte* source_pos = source;
-	byte* dest_pos = dest;
-	unsigned short mask = 0;
-	do {
-		mask >>= 1;
-		if ((mask & 0xFF00) == 0) {
-			mask = *source_pos | 0xFF00;
-			source_pos++;
-		}
-		if (mask & 1) {
-			*window_pos = *dest_pos = *source_pos;
-			window_pos++;
-			dest_pos++;
-			source_pos++;
-			if (window_pos >= window_end) window_pos = window;
-			--remaining;
-		} else {
-			unsigned short copy_info = *source_pos;
-			source_pos++;
-			copy_info = (copy_info << 8) | *source_pos;
-			source_pos++;
-			byte* copy_source = window + (copy_info & 0x3FF);
-			byte copy_length = (copy_info >> 10) + 3;
-			do {
-				*window_pos = *dest_pos = *copy_source;
-				window_pos++;
-				dest_pos++;
-				copy_source++;
-				if (copy_source >= window_end) copy_source = window;
-				if (window_pos >= window_end) window_pos = window;
-				--remaining;
-				--copy_length;
-			} while (remaining && copy_length);
-		}
-	} while (remaining);
-//	end:
-	free(window);
-	return dest;
+static thread_local unsigned char lzgWindow[0x400]; //Sliding window used by the LZG decoders below. There's one per thread so we don't allocate a window for every image
+
+struct lzgReader_s //Decodes left-to-right LZG data in pieces, so we can decode one row at a time
+{
+	const unsigned char *src;
+	const unsigned char *srcEnd; //Everything after the end of the data is read as zeros
+	int windowPos;
+	unsigned short mask;
+	int copySource; //Window position of the current back-reference
+	int copyLength; //Bytes left of the current back-reference
+};
+
+static void InitLZGReader(lzgReader_s *reader, const unsigned char *source, unsigned int sourceSize) //Uses this thread's LZG window, so only one reader per thread can be active at a time
+{
+	memset(lzgWindow, 0, 0x400);
+	reader->src = source;
+	reader->srcEnd = source + sourceSize;
+	reader->windowPos = 0x400 - 0x42;
+	reader->mask = 0;
+	reader->copySource = 0;
+	reader->copyLength = 0;
+}
+
+static bool EnoughLZGInput(lzgReader_s *reader) //Checks if there's enough data left for the next literal or back-reference
+{
+	int available = (int) (reader->srcEnd - reader->src);
+	unsigned short mask = reader->mask >> 1;
+	if((mask & 0xFF00) == 0) //Next token starts with a new mask byte
+	{
+		if(available < 1)
+			return 0;
+		mask = reader->src[0] | 0xFF00;
+		available--;
+	}
+	return available >= ((mask & 1) ? 1 : 2);
 }
 
 //Based on SDL-PoP code
-byte* decompress_lzg_ud(byte* dest,const byte* source,int dest_length,int stride,int height) {
-	byte* window = (byte*) malloc(0x400);
-	if (window == NULL) return NULL;
-	memset(window, 0, 0x400);
-	byte* window_pos = window + 0x400 - 0x42; // bx
-	short remaining = height; // cx
-	byte* window_end = window + 0x400; // dx
-	const byte* source_pos = source;
-	byte* dest_pos = dest;
-	unsigned short mask = 0;
-	short dest_end = dest_length - 1;
-	do {
-		mask >>= 1;
-		if ((mask & 0xFF00) == 0) {
-			mask = *source_pos | 0xFF00;
-			source_pos++;
-		}
-		if (mask & 1) {
-			*window_pos = *dest_pos = *source_pos;
-			window_pos++;
-			source_pos++;
-			dest_pos += stride;
-			--remaining;
-			if (remaining == 0) {
-				dest_pos -= dest_end;
-				remaining = height;
+static void ReadLZG(lzgReader_s *reader, unsigned char *dest, int length)
+{
+	unsigned char *window = lzgWindow;
+	while(length)
+	{
+		if(reader->copyLength == 0)
+		{
+			if(reader->srcEnd - reader->src < 3 && !EnoughLZGInput(reader)) //We only need to look closer when we're near the end of the data
+			{
+				reader->src = reader->srcEnd;
+				memset(dest, 0, length);
+				return;
 			}
-			if (window_pos >= window_end) window_pos = window;
-			--dest_length;
-		} else {
-			unsigned short copy_info = *source_pos;
-			source_pos++;
-			copy_info = (copy_info << 8) | *source_pos;
-			source_pos++;
-			byte* copy_source = window + (copy_info & 0x3FF);
-			byte copy_length = (copy_info >> 10) + 3;
-			do {
-				*window_pos = *dest_pos = *copy_source;
-				window_pos++;
-				copy_source++;
-				dest_pos += stride;
-				--remaining;
-				if (remaining == 0) {
-					dest_pos -= dest_end;
-					remaining = height;
-				}
-				if (copy_source >= window_end) copy_source = window;
-				if (window_pos >= window_end) window_pos = window;
-				--dest_length;
-				--copy_length;
-			} while (dest_length && copy_length);
+			reader->mask >>= 1;
+			if((reader->mask & 0xFF00) == 0)
+			{
+				reader->mask = *reader->src | 0xFF00;
+				reader->src++;
+			}
+			if(reader->mask & 1) //Literal byte
+			{
+				*dest = window[reader->windowPos] = *reader->src;
+				reader->src++;
+				dest++;
+				reader->windowPos = (reader->windowPos + 1) & 0x3FF;
+				length--;
+				continue;
+			}
+			unsigned short copyInfo = (reader->src[0] << 8) | reader->src[1]; //Back-reference into the window
+			reader->src += 2;
+			reader->copySource = copyInfo & 0x3FF;
+			reader->copyLength = (copyInfo >> 10) + 3;
+		}
+		while(reader->copyLength && length)
+		{
+			*dest = window[reader->windowPos] = window[reader->copySource];
+			dest++;
+			reader->copySource = (reader->copySource + 1) & 0x3FF;
+			reader->windowPos = (reader->windowPos + 1) & 0x3FF;
+			reader->copyLength--;
+			length--;
 		}
-	} while (dest_length);
-//	end:
-	free(window);
-	return dest;
+	}
 }
 
-//Based on SDL-PoP code
-void decompr_img(byte* dest,const unsigned char *sourceData ,int decomp_size,int compressMethod, int depth, int height, int stride) {
-	switch (compressMethod) {
-		case 0: // RAW left-to-right
-			memcpy(dest, sourceData, decomp_size);
-		break;
-		case 1: // RLE left-to-right
-			decompress_rle_lr(dest, sourceData, decomp_size);
-		break;
-		case 2: // RLE up-to-down
-			decompress_rle_ud(dest, sourceData, decomp_size, stride, height);
-		break;
-		case 3: // LZG left-to-right
-			decompress_lzg_lr(dest, sourceData, decomp_size);
-		break;
-		case 4: // LZG up-to-down
-			decompress_lzg_ud(dest, sourceData, decomp_size, stride, height);
-		break;
+static thread_local unsigned char columnTile[16 * 2048]; //16 byte columns of an up-to-down image (images are at most 2048 pixels tall)
+
+static void DecodeUpToDown(unsigned char *dest, const unsigned char *src, unsigned int srcSize, int compressMethod, int stride, int height) //Up-to-down data is stored one byte column at a time. Writing it straight into the image puts every byte on a different row, so we decode 16 columns into a small tile and copy the tile into place one row at a time
+{
+	rleReader_s rle = {}; //Only the reader for compressMethod is set up below
+	lzgReader_s lzg = {};
+	if(compressMethod == 2)
+		InitRLEReader(&rle, src, srcSize);
+	else
+		InitLZGReader(&lzg, src, srcSize);
+
+	for(int column = 0; column < stride; column += 16)
+	{
+		int columnCount = stride - column < 16 ? stride - column : 16;
+		if(compressMethod == 2)
+			ReadRLE(&rle, columnTile, columnCount * height);
+		else
+			ReadLZG(&lzg, columnTile, columnCount * height);
+		for(int y = 0; y < height; y++)
+		{
+			unsigned char *destPos = &dest[y * stride + column];
+			const unsigned char *tilePos = &columnTile[y];
+			for(int i = 0; i < columnCount; i++, tilePos += height)
+				destPos[i] = *tilePos;
+		}
 	}
 }
 
 //Based on SDL-PoP code
-unsigned char *conv_to_8bpp(unsigned char *in_data, int width, int height, int stride, int depth) {
-	unsigned char *out_data = new unsigned char[width * height];
+void conv_to_8bpp(unsigned char *out_data, const unsigned char *in_data, int width, int height, int stride, int depth, bool useKernels = 1) { //The scalar loop is the reference for the SIMD kernels, and it also handles whatever is left of a row after the kernel
 	int pixels_per_byte = 8 / depth;
 	int mask = (1 << depth) - 1;
+	unpackKernel_t kernel = useKernels ? Prince_UnpackKernel(depth) : 0;
 	for (int y = 0; y < height; ++y) {
-		unsigned char* in_pos = in_data + y*stride;
+		const unsigned char* in_pos = in_data + y*stride;
 		unsigned char* out_pos = out_data + y*width;
-		for (int x_pixel = 0, x_byte = 0; x_byte < stride; ++x_byte) {
+		int x_pixel = 0, x_byte = 0;
+		if (kernel) { //Only bytes where every pixel is within the row
+			x_byte = kernel(out_pos, in_pos, width / pixels_per_byte);
+			x_pixel = x_byte * pixels_per_byte;
+			in_pos += x_byte;
+			out_pos += x_pixel;
+		}
+		for (; x_byte < stride; ++x_byte) {
 			unsigned char v = *in_pos;
 			int shift = 8;
 			for (int pixel_in_byte = 0; pixel_in_byte < pixels_per_byte && x_pixel < width; ++pixel_in_byte, ++x_pixel) {
@@ -370,171 +377,285 @@ unsigned char *conv_to_8bpp(unsigned char *in_data, int width, int height, int s
 			}
 			++in_pos;
 		}
+		for (; x_pixel < width; ++x_pixel) //Depths that don't divide 8 run out of bytes before the row is full
+			*out_pos++ = 0;
 	}
-	return out_data;
 }
 
 //Based on PR code
 /* modulus to be used in the 10 bits of the algorithm */
 #define LZG_WINDOW_SIZE    0x400 /* =1024=1<<10 */
-
-/* LZG expansion algorithm sub function */
-unsigned char popBit(unsigned char *byte)
-{
-	register unsigned char bit=(*byte)&1;
-	(*byte)>>=1;
-	return bit;
-}
+#define LZG_MAXOUTPUT 0x10000 /* largest size we can get from the 16-bit size stored before LZG data */
+#define LZG_MAXGROUPINPUT 17 /* mask byte followed by 8 back-references */
+#define LZG_MAXREPEAT 66
+static thread_local unsigned char lzgOutput[LZG_WINDOW_SIZE + LZG_MAXOUTPUT]; /* window followed by the expanded data, reused for every image decoded on this thread */
 
 //Based on PR code
-/* Expands LZ Groody algorithm. This is the core of PR */
-int expandLzg(const unsigned char* input, int inputSize, unsigned char** output2, int *outputSize)
+/* Expands one LZ Groody chunk. expandedSize is the size stored before the chunk, and it's changed to the size we actually got if the input ends early. Returns how many input bytes were used */
+static int ExpandLZGChunk(const unsigned char *input, int inputSize, int *expandedSize, const unsigned char **expanded) /* expanded points into a per-thread buffer that's overwritten by the next call */
 {
-
-	int                    oCursor=0, iCursor=0;
-	unsigned char          maskbyte=0;
-	/* TODO: Don't reserve more than needed. */
-	//unsigned char          output[65500];
-	unsigned char *output = new unsigned char[65500];
-	register int           loc;
-	register unsigned char rep, k;
-
-	if(*outputSize)
-		*outputSize += LZG_WINDOW_SIZE;
-	else
-		*outputSize = 65500;
+	unsigned char *output = lzgOutput;
+	int iCursor = 0, oCursor = LZG_WINDOW_SIZE;
+	int outputEnd = LZG_WINDOW_SIZE + (*expandedSize ? *expandedSize : 65500 - LZG_WINDOW_SIZE);
 
 	/* initialize the first 1024 bytes of the window with zeros */
-	for(oCursor=0;oCursor<LZG_WINDOW_SIZE;output[oCursor++]=0);
+	memset(output, 0, LZG_WINDOW_SIZE);
 
 	/* main loop */
-	while (iCursor<inputSize&&(oCursor)<(*outputSize)) {
-		maskbyte=input[iCursor++];
-		for (k=8;k&&(iCursor<inputSize)&&(oCursor)<(*outputSize);k--) { /* fix by David */
-			if (popBit(&maskbyte)) {
-				output[oCursor++]=input[iCursor++]; /* copy input to output */
+	while (iCursor < inputSize && oCursor < outputEnd) {
+		/* we only check bounds for each byte when we're close to the end of the input or output */
+		bool checked = inputSize - iCursor < LZG_MAXGROUPINPUT || outputEnd - oCursor < 8 * LZG_MAXREPEAT;
+		unsigned char maskbyte = input[iCursor++];
+		for (int k = 8; k; k--, maskbyte >>= 1) {
+			if (checked && (iCursor >= inputSize || oCursor >= outputEnd))
+				break;
+			if (maskbyte & 1) {
+				output[oCursor++] = input[iCursor++]; /* copy input to output */
 			} else {
+				if (checked && iCursor + 2 > inputSize) {
+					iCursor = inputSize;
+					break;
+				}
 				/*
 				 * loc:
-				 *  10 bits for the slide iCursorition (S). Add 66 to this number,
+				 *  10 bits for the slide position (S). Add 66 to this number,
 				 *  substract the result to the current oCursor and take the last 10 bits.
 				 * rep:
 				 *  6 bits for the repetition number (R). Add 3 to this number.
 				 */
-				loc= 66 + ((input[iCursor] & 0x03 /*00000011*/) <<8) + input[iCursor+1];
-				rep= 3  + ((input[iCursor] & 0xfc /*11111100*/) >>2);
+				int loc = 66 + ((input[iCursor] & 0x03 /*00000011*/) << 8) + input[iCursor + 1];
+				int rep = 3 + ((input[iCursor] & 0xfc /*11111100*/) >> 2);
+				iCursor += 2; /* move the cursor 2 bytes ahead */
 
-				iCursor+=2; /* move the cursor 2 bytes ahead */
+				loc = (oCursor - loc) & 0x3ff; /* this is the real loc number (allways positive!) */
+				if (loc == 0) loc = 0x400; /* by David */
 
-				loc=(oCursor-loc)&0x3ff; /* this is the real loc number (allways positive!) */
-				if(loc==0) loc=0x400; /* by David */
-
-				while (rep--) { /* repeat pattern in output */
-					output[oCursor]=output[oCursor-loc];
-					oCursor++;
-				}
+				if (checked && rep > outputEnd - oCursor) /* don't go past the size the chunk says it has */
+					rep = outputEnd - oCursor;
+				for (; rep; rep--, oCursor++) /* repeat pattern in output */
+					output[oCursor] = output[oCursor - loc];
 			}
 		}
 	}
 
-	inputSize-=iCursor;
 	/* ignore the first 1024 bytes */
-	*outputSize=oCursor-LZG_WINDOW_SIZE;
-	
-	//*output2=(unsigned char*)malloc(*outputSize);
-	*output2= new unsigned char[*outputSize];
-
-	for(iCursor=LZG_WINDOW_SIZE;iCursor<oCursor;iCursor++)
-		(*output2)[iCursor-LZG_WINDOW_SIZE]=output[iCursor];
-
-	delete[]output;
-
-	if(oCursor>=(*outputSize))
-		return inputSize; /* TODO: check if this case never happens !!! */
+	*expandedSize = oCursor - LZG_WINDOW_SIZE;
+	*expanded = &output[LZG_WINDOW_SIZE];
+	return iCursor;
+}
 
-	return (!maskbyte)-1;
-	/*return rep?COMPRESS_RESULT_WARNING:COMPRESS_RESULT_SUCCESS;*/
+//Based on PR code
+/* Expands one RLE line. Returns how many bytes were written, or -1 if the line doesn't fit in outputSize */
+static int ExpandRLELine(const unsigned char *input, int inputSize, unsigned char *output, int outputSize)
+{
+	int iCursor = 0, oCursor = 0;
+	while (iCursor < inputSize) {
+		int rep = input[iCursor++];
+		if (rep & 0x80) { /* repeat */
+			rep = (rep & 0x7f) + 1;
+			if (iCursor >= inputSize)
+				break;
+			if (rep > outputSize - oCursor)
+				return -1;
+			memset(&output[oCursor], input[iCursor++], rep);
+		} else { /* copy */
+			rep++;
+			if (rep > inputSize - iCursor)
+				rep = inputSize - iCursor;
+			if (rep > outputSize - oCursor)
+				return -1;
+			memcpy(&output[oCursor], &input[iCursor], rep);
+			iCursor += rep;
+		}
+		oCursor += rep;
+	}
+	return oCursor;
 }
 
 //Based on PR code
-/* Expands RLE algorithm */
-bool expandRleC(const unsigned char *input, int inputSize, unsigned char *output, int *outputSize)
+static bool DecodePOP2Image(const unsigned char *input, unsigned int inputSize, unsigned char *output, unsigned int width, unsigned int height, unsigned int *decodedSize) //Used for POP2 images with up to 256 colours. Returns 0 if the data goes past width * height pixels (whatever fits is still decoded)
 {
-	register unsigned char rep = 0;
-	int oCursor = 0;
-	int iCursor = 0;
+	unsigned int outputSize = width * height, outputPos = 0, inputPos = 0;
+	*decodedSize = 0;
 
-	/* main loop */
-	while(iCursor < inputSize)
+	//The image is a list of LZG compressed chunks that start with their expanded size. Each chunk is a list of RLE compressed lines that start with their compressed size.
+	while(inputPos + 2 <= inputSize && outputPos < outputSize)
 	{
-		rep = (input[iCursor++]);
-		if(rep&0x80) /* repeat */
-		{ 
-			rep&=(~0x80);
-			rep++;
-			while (rep--) (output)[oCursor++]=input[iCursor];
-			iCursor++;
-		}
-		else /* jump */
+		int chunkSize = *(const unsigned short *) &input[inputPos];
+		inputPos += 2;
+		const unsigned char *chunk;
+		inputPos += ExpandLZGChunk(&input[inputPos], inputSize - inputPos, &chunkSize, &chunk);
+
+		int chunkPos = 0, lineSize = 0;
+		do
 		{
-			rep++;
-			while ((rep--)&&(iCursor<inputSize))
+			if(chunkPos + 2 > chunkSize)
+				break;
+			int compressedLineSize = *(const unsigned short *) &chunk[chunkPos];
+			chunkPos += 2;
+			if(compressedLineSize > chunkSize - chunkPos) //Broken chunk, so we stop here
+			{
+				*decodedSize = outputPos;
+				return 1;
+			}
+			lineSize = ExpandRLELine(&chunk[chunkPos], compressedLineSize, &output[outputPos], outputSize - outputPos);
+			if(lineSize < 0)
 			{
-				(output)[oCursor++]=input[iCursor++];
+				*decodedSize = outputPos;
+				return 0;
 			}
+			outputPos += lineSize;
+			chunkPos += compressedLineSize;
+		} while(lineSize == (int) width && chunkPos < chunkSize);
+	}
+	*decodedSize = outputPos;
+	return 1;
+}
+
+static bool DecodeImageRows(unsigned char *dest, const unsigned char *src, unsigned int srcSize, int compressMethod, int depth, unsigned int width, unsigned int height, const unsigned int *lookup, bool flipY) //Decodes a raw, RLE or LZG left-to-right image without buffering the whole image. If lookup is null, dest gets 8-bit palette indices instead of RGBA. Returns 1 if index 0 was expanded to RGBA anywhere
+{
+	unsigned char packedRow[2048]; //Images are at most 2048 pixels wide and pixels are at most 8 bits
+	unsigned char indexRow[2048];
+	int stride = (depth * width + 7) / 8;
+	int bytesPerPixel = lookup ? 4 : 1;
+	expandKernel_t expand = Prince_ExpandKernel();
+	bool foundZero = 0;
+	rleReader_s rle = {}; //Only the reader for compressMethod is set up below
+	lzgReader_s lzg = {};
+	if(compressMethod == 1)
+		InitRLEReader(&rle, src, srcSize);
+	else if(compressMethod == 3)
+		InitLZGReader(&lzg, src, srcSize);
+
+	for(unsigned int y = 0; y < height; y++)
+	{
+		const unsigned char *packed = packedRow;
+		if(compressMethod == 0 && (y + 1) * stride <= srcSize)
+			packed = &src[y * stride];
+		else if(compressMethod == 0) //Data ends before this row does
+		{
+			unsigned int available = y * stride < srcSize ? srcSize - y * stride : 0;
+			if(available)
+				memcpy(packedRow, &src[y * stride], available);
+			memset(&packedRow[available], 0, stride - available);
+		}
+		else if(compressMethod == 1)
+			ReadRLE(&rle, packedRow, stride);
+		else
+			ReadLZG(&lzg, packedRow, stride);
+
+		unsigned char *destRow = &dest[(flipY ? height - 1 - y : y) * width * bytesPerPixel];
+		if(!lookup)
+			conv_to_8bpp(destRow, packed, width, 1, stride, depth);
+		else if(depth == 8)
+			foundZero |= expand(destRow, packed, width, lookup);
+		else
+		{
+			conv_to_8bpp(indexRow, packed, width, 1, stride, depth);
+			foundZero |= expand(destRow, indexRow, width, lookup);
 		}
 	}
-	
-	*outputSize=oCursor;
-	return (rep==255)?1:0;
+	return foundZero;
 }
 
-//Based on PR code
-bool pop2decompress(const unsigned char* input, int inputSize, int verify, unsigned char** output,unsigned int* outputSize)
+static bool ReadPOPImageHeader(const unsigned char *srcImgData, unsigned int srcImgDataSize, unsigned int *width, unsigned int *height, unsigned int *colourCount) //Returns 0 if this can't be valid image data
 {
-	unsigned char* tempOutput;
-	unsigned char* lineI; /* chunk */
-	unsigned char* lineO; /* chunk */
-	int            lineSize;
-	int            aux, remaining = inputSize;
-	int            tempOutputSize;
-
-	*output = new unsigned char[64000]; //320x200 = 64000
-	lineO = *output;
-	*outputSize = 0;
-
-	while(remaining)
+	const imgHeader_s *header = (const imgHeader_s *) srcImgData;
+	if(srcImgDataSize <= sizeof(imgHeader_s) || header->height == 0 || header->width == 0 || header->height > 2048 || header->width > 2048)
 	{
-		tempOutputSize = (unsigned short &) *input;
-		input += 2; inputSize -= 2;
-		remaining=expandLzg(input,inputSize,&tempOutput,&tempOutputSize);
+		StatusUpdate("Warning: srcImgData contains invalid POP image data");
+		return 0;
+	}
+	*height = header->height;
+	*width = header->width;
+	if(colourCount)
+		*colourCount = header->info[0] == 1 ? 256 : 1 << (((header->info[1] >> 4) & 7) + 1);
+	return 1;
+}
 
-		/* Second layer expand each rle line */
-		lineI=tempOutput;
-		do
+static bool DecodePOPImage(const unsigned char *srcImgData, unsigned int srcImgDataSize, unsigned char *dest, unsigned int width, unsigned int height, const unsigned int *lookup, bool flipY, princeImageScratch_s *scratch, unsigned int *decodedPixels = 0) //dest gets RGBA if lookup is defined, otherwise 8-bit palette indices. Returns 1 if any pixel ended up as palette index 0 (transparent). decodedPixels gets how many pixels (in decode order) the image data covered. The rest are zeroed
+{
+	const imgHeader_s *header = (const imgHeader_s *) srcImgData;
+	const unsigned char *src = &srcImgData[sizeof(imgHeader_s)];
+	unsigned int srcSize = srcImgDataSize - sizeof(imgHeader_s);
+	unsigned int bytesPerPixel = lookup ? 4 : 1;
+	int depth = ((header->info[1] >> 4) & 7) + 1;
+	int compressMethod = (header->info[1]) & 0x0F;
+	int stride = (depth * width + 7) / 8;
+	bool foundZero = 0;
+	if(decodedPixels)
+		*decodedPixels = width * height;
+	if(header->info[0] == 1) //This is used for POP2 images that have up to 256 colours
+	{
+		//Decode image data into 8-bit palletized image data. If we're outputting indices in the same row order, we can decode straight into the output
+		unsigned int pixelCount = width * height;
+		bool direct = !lookup && !flipY;
+		unsigned char *rawImgData = direct ? dest : scratch ? ReserveScratchBuffer(&scratch->indexed, pixelCount) : new unsigned char[pixelCount];
+		unsigned int rawImgDataSize;
+		if(!DecodePOP2Image(src, srcSize, rawImgData, width, height, &rawImgDataSize))
+			StatusUpdate("Warning: POP2 image data is bigger than its %ux%u size, so it was cut off", width, height);
+		if(rawImgDataSize < pixelCount) //Pixels the image data didn't cover are left transparent
 		{
-			aux = (unsigned short &) *lineI;
-			lineI += 2;
-			if (aux > tempOutputSize)
-				return 0;
-			expandRleC(lineI, aux, lineO, &lineSize);
-			lineO += lineSize;
-			*outputSize += lineSize;
-			tempOutputSize -= aux;
-			tempOutputSize -= 2;
-			lineI += aux;
-		} while(lineSize == verify && tempOutputSize > 0);
-        {
-           int oldinputSize = inputSize;
-           inputSize = remaining;
-		   input += (oldinputSize-inputSize);
-        }
-		delete[]tempOutput;
-     }
-	return 1;
+			foundZero = 1;
+			if(decodedPixels)
+				*decodedPixels = rawImgDataSize;
+			if(direct)
+				memset(&dest[rawImgDataSize], 0, pixelCount - rawImgDataSize);
+			else
+				memset(dest, 0, pixelCount * bytesPerPixel);
+		}
+		if(direct)
+			return foundZero;
+
+		//Convert to raw RGBA (or just flip the rows)
+		expandKernel_t expand = Prince_ExpandKernel();
+		for(unsigned int y = 0; y * width < rawImgDataSize; y++)
+		{
+			unsigned int rowPixels = rawImgDataSize - y * width < width ? rawImgDataSize - y * width : width;
+			unsigned char *destRow = &dest[(flipY ? height - 1 - y : y) * width * bytesPerPixel];
+			if(lookup)
+				foundZero |= expand(destRow, &rawImgData[y * width], rowPixels, lookup);
+			else
+				memcpy(destRow, &rawImgData[y * width], rowPixels);
+		}
+		if(!scratch)
+			delete[]rawImgData;
+	}
+	else if(compressMethod == 0 || compressMethod == 1 || compressMethod == 3) //Left-to-right methods go straight to the output one row at a time
+		foundZero = DecodeImageRows(dest, src, srcSize, compressMethod, depth, width, height, lookup, flipY);
+	else if(compressMethod == 2 || compressMethod == 4) //Up-to-down methods need the whole packed image before we can go through it one row at a time. This is used for the rest of the graphical assets in POP1 and most sprites in POP2
+	{
+		unsigned int intDataSize = height * stride;
+		unsigned char *intData = scratch ? ReserveScratchBuffer(&scratch->intermediate, intDataSize) : new unsigned char[intDataSize]; //Intermediate data
+		DecodeUpToDown(intData, src, srcSize, compressMethod, stride, height);
+		foundZero = DecodeImageRows(dest, intData, intDataSize, 0, depth, width, height, lookup, flipY);
+		if(!scratch)
+			delete[]intData;
+	}
+	else
+	{
+		StatusUpdate("Warning: Unknown compression method %i in POP image data", compressMethod);
+		memset(dest, 0, width * height * bytesPerPixel);
+		foundZero = 1;
+		if(decodedPixels)
+			*decodedPixels = 0;
+	}
+	return foundZero;
+}
+
+static void DropAlphaChannel(unsigned char *imgData, unsigned int pixelCount, unsigned int *imgDataSize, unsigned char *channels) //Turns RGBA into RGB in place
+{
+	for(unsigned int i = 0; i < pixelCount; i++)
+	{
+		imgData[i * 3] = imgData[i * 4];
+		imgData[i * 3 + 1] = imgData[i * 4 + 1];
+		imgData[i * 3 + 2] = imgData[i * 4 + 2];
+	}
+	*channels = 3;
+	*imgDataSize = pixelCount * 3;
 }
 
-bool Prince_ConvPOPImageData(unsigned char *srcImgData, unsigned int srcImgDataSize, princeGenericPalette_s *paletteData, unsigned char **destImgData, unsigned int *destImgDataSize, unsigned int *width, unsigned int *height, unsigned char *channels, bool flipY)
+bool Prince_ConvPOPImageData(const unsigned char *srcImgData, unsigned int srcImgDataSize, const princePalette_s *paletteData, unsigned char **destImgData, unsigned int *destImgDataSize, unsigned int *width, unsigned int *height, unsigned char *channels, bool flipY, princeImageScratch_s *scratch) //If scratch is defined, all buffers are taken from it and destImgData will point into the scratch (so don't delete it). Channels is 3 (RGB) if no pixel is transparent, otherwise 4 (RGBA)
 {
 	//Check pointers
 	if(destImgData == 0 || destImgDataSize == 0 || height == 0 || width == 0 || channels == 0 || paletteData == 0)
@@ -557,69 +678,107 @@ bool Prince_ConvPOPImageData(unsigned char *srcImgData, unsigned int srcImgDataS
 		return 0;
 	}
 
-	//Check if this can't be valid image data
-	imgHeader_s *header = (imgHeader_s *) srcImgData;
-	if(srcImgDataSize <= sizeof(imgHeader_s) || header->height == 0 || header->width == 0 || header->height > 2048 || header->width > 2048)
+	//Read header, allocate outgoing image data buffer, and define outgoing values
+	if(!ReadPOPImageHeader(srcImgData, srcImgDataSize, width, height, 0))
+		return 0;
+	*channels = 4;
+	*destImgDataSize = *height * *width * *channels;
+	*destImgData = scratch ? ReserveScratchBuffer(&scratch->output, *destImgDataSize) : new unsigned char[*destImgDataSize];
+
+	//If no pixel used the transparent palette entry, we drop the alpha channel so the image can be saved as RGB
+	if(!DecodePOPImage(srcImgData, srcImgDataSize, *destImgData, *width, *height, paletteData->rgba, flipY, scratch))
+		DropAlphaChannel(*destImgData, *width * *height, destImgDataSize, channels);
+	return 1;
+}
+
+bool Prince_DecodePOPImageIndices(const unsigned char *srcImgData, unsigned int srcImgDataSize, unsigned char **destImgData, unsigned int *width, unsigned int *height, unsigned int *colourCount, bool flipY, princeImageScratch_s *scratch) //Same as Prince_ConvPOPImageData() but outputs one 8-bit palette index per pixel. colourCount is how many palette entries the image can refer to
+{
+	//Check pointers
+	if(destImgData == 0 || height == 0 || width == 0 || colourCount == 0)
 	{
-		StatusUpdate("Warning: srcImgData contains invalid POP image data");
+		StatusUpdate("Warning: One incoming pointer is null during Prince_DecodePOPImageIndices()");
 		return 0;
 	}
 
-	//Read header, allocate outgoing image data buffer, and define outgoing values
-	*height = header->height;
-	*width = header->width;
-	*channels = 4; //TODO: Should we check if there's any alpha in the image and change this to 3 if there's none?
-	*destImgDataSize = *height * *width * *channels;
-	*destImgData = new unsigned char[*destImgDataSize];
+	//Init outgoing values
+	*destImgData = 0;
+	*height = 0;
+	*width = 0;
+	*colourCount = 0;
 
-	//Decode image data into 8-bit palletized image data
-	unsigned char *rawImgData = 0;
-	unsigned int rawImgDataSize = *height * *width;
+	if(srcImgData == 0)
 	{
-		int depth = ((header->info[1] >> 4) & 7) + 1;
-		int compressMethod = (header->info[1]) & 0x0F;
-		int stride = (depth * *width + 7) / 8;
-		if(header->info[0] == 1) //This is used for POP2 images that have up to 256 colours
-		{
-			pop2decompress(&srcImgData[sizeof(imgHeader_s)], srcImgDataSize - sizeof(imgHeader_s), header->width, &rawImgData, &rawImgDataSize);
-		}
-		else //This is used for all graphical assets in POP1 and most sprites in POP2
-		{
-			unsigned int intDataSize = *height * stride;
-			unsigned char *intData = new unsigned char[intDataSize]; //Intermediate data
-			decompr_img(intData, &srcImgData[sizeof(imgHeader_s)], *height * stride, compressMethod, depth, *height, stride);
-			rawImgData = conv_to_8bpp(intData, *width, *height, stride, depth); //Convert to raw 8-bit palletized image data
-			delete[]intData;
-		}
+		StatusUpdate("Warning: srcImgData is null during Prince_DecodePOPImageIndices()");
+		return 0;
 	}
 
-	//Convert to raw RGBA
-	{
-		int stride = *width * *channels;
-		unsigned int destPos = flipY ? (*height - 1) * stride : 0;
-		for(unsigned int srcPos = 0, stridePos = 0; srcPos < rawImgDataSize; destPos += 4, srcPos++, stridePos += 4)
-		{
-			if(flipY && stridePos == stride)
-			{
-				stridePos = 0;
-				destPos -= stride * 2;
-			}
+	if(!ReadPOPImageHeader(srcImgData, srcImgDataSize, width, height, colourCount))
+		return 0;
+	unsigned int destImgDataSize = *height * *width;
+	*destImgData = scratch ? ReserveScratchBuffer(&scratch->output, destImgDataSize) : new unsigned char[destImgDataSize];
+
+	DecodePOPImage(srcImgData, srcImgDataSize, *destImgData, *width, *height, 0, flipY, scratch);
+	return 1;
+}
 
-			(*destImgData)[destPos + 0] = paletteData->colours[rawImgData[srcPos]].r;
-			(*destImgData)[destPos + 1] = paletteData->colours[rawImgData[srcPos]].g;
-			(*destImgData)[destPos + 2] = paletteData->colours[rawImgData[srcPos]].b;
+bool Prince_DecodeIndexedImage(const unsigned char *srcImgData, unsigned int srcImgDataSize, princeIndexedImage_s *image, princeImageScratch_s *scratch) //Decodes an image once so it can be rendered under any number of palettes with Prince_RenderIndexedImage(). Free it with Prince_FreeIndexedImage()
+{
+	memset(image, 0, sizeof(princeIndexedImage_s));
+	if(srcImgData == 0)
+	{
+		StatusUpdate("Warning: srcImgData is null during Prince_DecodeIndexedImage()");
+		return 0;
+	}
+	if(!ReadPOPImageHeader(srcImgData, srcImgDataSize, &image->width, &image->height, &image->colourCount))
+		return 0;
+	image->indices = new unsigned char[image->width * image->height];
+	DecodePOPImage(srcImgData, srcImgDataSize, image->indices, image->width, image->height, 0, 0, scratch, &image->decodedPixels);
+	return 1;
+}
 
-			if(rawImgData[srcPos] == 0) //First palette entry is transparent entry
-				(*destImgData)[destPos + 3] = 0;
-			else
-				(*destImgData)[destPos + 3] = 255;
-		}
-		delete[]rawImgData;
+bool Prince_RenderIndexedImage(const princeIndexedImage_s *image, const princePalette_s *paletteData, unsigned char **destImgData, unsigned int *destImgDataSize, unsigned char *channels, princeImageScratch_s *scratch) //Gives the same output as Prince_ConvPOPImageData() without decompressing anything. If scratch is defined, destImgData will point into the scratch (so don't delete it)
+{
+	*destImgData = 0;
+	*destImgDataSize = 0;
+	*channels = 0;
+	if(image->indices == 0 || paletteData == 0)
+	{
+		StatusUpdate("Warning: Image or palette is missing during Prince_RenderIndexedImage()");
+		return 0;
 	}
 
+	*channels = 4;
+	*destImgDataSize = image->width * image->height * 4;
+	*destImgData = scratch ? ReserveScratchBuffer(&scratch->output, *destImgDataSize) : new unsigned char[*destImgDataSize];
+
+	//Pixels the image data didn't cover are zeroed like they are when we decode straight to RGBA
+	expandKernel_t expand = Prince_ExpandKernel();
+	bool foundZero = expand(*destImgData, image->indices, image->decodedPixels, paletteData->rgba);
+	unsigned int pixelCount = image->width * image->height;
+	if(image->decodedPixels < pixelCount)
+	{
+		memset(&(*destImgData)[image->decodedPixels * 4], 0, (pixelCount - image->decodedPixels) * 4);
+		foundZero = 1;
+	}
+	if(!foundZero)
+		DropAlphaChannel(*destImgData, pixelCount, destImgDataSize, channels);
 	return 1;
 }
 
+void Prince_FreeIndexedImage(princeIndexedImage_s *image)
+{
+	if(image->indices)
+		delete[]image->indices;
+	image->indices = 0;
+}
+
+void Prince_FreeImageScratch(princeImageScratch_s *scratch)
+{
+	FreeScratchBuffer(&scratch->intermediate);
+	FreeScratchBuffer(&scratch->indexed);
+	FreeScratchBuffer(&scratch->output);
+}
+
 static bool PathWithoutExt(const char *inPath, char *outPath)
 {
 	int lastDot = -1, pos = 0;
@@ -639,7 +798,7 @@ static bool PathWithoutExt(const char *inPath, char *outPath)
 	return 1;
 }
 
-bool Prince_ExtractDAT(const char *path, unsigned char *palData, unsigned int palSize, int palType)
+bool Prince_ExtractDAT(const char *path, const unsigned char *palData, unsigned int palSize, int palType, threadPool_s *pool)
 {
 	bool failed = 0;
 
@@ -648,89 +807,105 @@ bool Prince_ExtractDAT(const char *path, unsigned char *palData, unsigned int pa
 	PathWithoutExt(path, pathWithoutExt);
 
 	int imageCount = 0;
-	unsigned char *fileData = 0;
+	const unsigned char *fileData = 0; //Points into the mapped DAT
 	unsigned int fileDataSize = 0;
-	princeGenericPalette_s palette;
-	bool palLoaded = 0;
+	const princePalette_s *palette = 0;
+	const princePalette_s **variantPalettes = 0; //Every palette in a multipalette, if we render images once for each of them
+	int variantCount = 0;
+	princeImageCache_s *imageCache = 0; //Only used when images are rendered under several palettes, since that's the only time an entry is decoded more than once
+	extractPipeline_s *output = 0;
 
 	if(palData)
 	{
-		Prince_ConvertPaletteToGeneric(&palette, palData, palSize, palType);
-		palLoaded = 1;
+		palette = Prince_ConvertPalette(palData, palSize, palType);
+		if(allPaletteVariants && palType == POP1_DATFORMAT_MULTIPAL && palSize >= POP1_MULTIPAL_VARIANTSIZE * 2)
+		{
+			variantCount = palSize / POP1_MULTIPAL_VARIANTSIZE;
+			variantPalettes = new const princePalette_s*[variantCount];
+			for(int i = 0; i < variantCount; i++)
+				variantPalettes[i] = Prince_ConvertPalette(palData, palSize, palType, i * POP1_MULTIPAL_VARIANTSIZE);
+			imageCache = Prince_CreateImageCache();
+		}
 	}
 
-	if(Prince_OpenDAT(path, &imageCount))
+	princeDat_s *dat = Prince_OpenDAT(path, &imageCount);
+	if(dat)
 	{
+		output = Pipeline_Create(pool);
+		if(imageCache)
+			Pipeline_UseImageCache(output, imageCache, path);
 		unsigned short id;
 		for(int i = 0; i < imageCount; i++)
 		{
-			if(fileData)
-			{
-				delete[]fileData;
-				fileData = 0;
-			}
-			if(!Prince_LoadEntryFromDAT(&fileData, &fileDataSize, i, -1, &id))
+			if(!Prince_LoadEntryPointerFromDAT(dat, &fileData, &fileDataSize, i, -1, &id))
 			{
 				failed = 1;
 				break;
 			}
 
-			int format = Prince_GuessDATFormat(fileData, fileDataSize, palLoaded);
-			if(format == POP1_DATFORMAT_PAL && !palLoaded)
+			int format = Prince_GuessDATFormat(fileData, fileDataSize, palette != 0);
+			if(format == POP1_DATFORMAT_PAL && !palette)
+				palette = Prince_ConvertPalette(fileData, fileDataSize, POP1_DATFORMAT_PAL);
+			else if(format == POP1_DATFORMAT_IMG && variantPalettes) //Convert once for every palette in the multipalette
 			{
-				Prince_ConvertPaletteToGeneric(&palette, fileData, fileDataSize, POP1_DATFORMAT_PAL);
-				palLoaded = 1;
+				for(int j = 0; j < variantCount && !failed; j++)
+				{
+					char imagePath[MAX_PATH];
+					sprintf_s(imagePath, MAX_PATH, "%s" PATHSEP "Variant%i" PATHSEP "res%u.%s", pathWithoutExt, j, id, ImageFormatExtension());
+					if(!Pipeline_QueueImage(output, imagePath, fileData, fileDataSize, variantPalettes[j], id))
+						failed = 1;
+				}
+				if(failed)
+					break;
 			}
-			else if(format == POP1_DATFORMAT_IMG)
+			else if(format == POP1_DATFORMAT_IMG) //Convert to PNG
 			{
-				unsigned char *newImgData = 0;
-				unsigned int newImgDataSize = 0, width = 0, height = 0;
-				unsigned char channels = 0;
-				if(!Prince_ConvPOPImageData(fileData, fileDataSize, &palette, &newImgData, &newImgDataSize, &width, &height, &channels))
+				char imagePath[MAX_PATH];
+				sprintf_s(imagePath, MAX_PATH, "%s" PATHSEP "res%u.%s", pathWithoutExt, id, ImageFormatExtension());
+				if(!Pipeline_QueueImage(output, imagePath, fileData, fileDataSize, palette))
 				{
 					failed = 1;
 					break;
 				}
-
-				//Convert to PNG
-				char pngPath[MAX_PATH];
-				sprintf_s(pngPath, MAX_PATH, "%s\\res%u.png", pathWithoutExt, id);
-				SaveImageAsPNG(pngPath, newImgData, width, height, channels);
-				delete[]newImgData;
 			}
 
 			if(format != POP1_DATFORMAT_IMG) //Write data to file (unless it's an image file, which we already would have converted and saved as PNG)
 			{
 				char binPath[MAX_PATH];
 				if(format == POP1_DATFORMAT_PAL)
-					sprintf_s(binPath, MAX_PATH, "%s\\res%u.pal", pathWithoutExt, id);
+					sprintf_s(binPath, MAX_PATH, "%s" PATHSEP "res%u.pal", pathWithoutExt, id);
 				else
-					sprintf_s(binPath, MAX_PATH, "%s\\res%u.bin", pathWithoutExt, id);
-				MakeDirectory_PathEndsWithFile(binPath);
-				FILE *file;
-				fopen_s(&file, binPath, "wb");
-				if(!file)
+					sprintf_s(binPath, MAX_PATH, "%s" PATHSEP "res%u.bin", pathWithoutExt, id);
+				if(!Pipeline_QueueFile(output, binPath, fileData, fileDataSize))
 				{
-					StatusUpdate("Warning: Failed to open %s for writing.", binPath);
 					failed = 1;
 					break;
 				}
-				fwrite(fileData, fileDataSize, 1, file);
-				fclose(file);
-				StatusUpdate("Wrote %s", binPath);
 			}
 		}
-		Prince_CloseDAT();
+		if(!Pipeline_Finish(output)) //Has to happen before we close the DAT as queued data points into it
+			failed = 1;
+		Prince_CloseDAT(dat);
 	}
 	else
 		failed = 1;
 
-	//Finish
-	if(fileData)
-		delete[]fileData;
+	if(imageCache)
+		Prince_FreeImageCache(imageCache);
+	if(palette)
+		Prince_ReleasePalette(palette);
+	for(int i = 0; i < variantCount; i++)
+		Prince_ReleasePalette(variantPalettes[i]);
+	if(variantPalettes)
+		delete[]variantPalettes;
 	return !failed;
 }
 
+void Prince_ExtractAllPaletteVariants(bool enable)
+{
+	allPaletteVariants = enable;
+}
+
 static const char *PredefinedPOP2ScriptAnimName(int id)
 {
 	switch(id)
@@ -972,7 +1147,47 @@ static const char *PredefinedPOP2ScriptAnimName(int id)
 	return 0;
 }
 
-bool Prince_ExtractDATv2(const char *path, unsigned char *palData, unsigned int palSize, int palType, int startId, int endId)
+princeExtractRule_s Prince_AutoPaletteRule(int startId, int endId)
+{
+	princeExtractRule_s rule = {startId, endId, 0, 0, 0, -1, -1};
+	return rule;
+}
+
+princeExtractRule_s Prince_DATPaletteRule(int startId, int endId, int palEntryType, int palEntryId, int palType)
+{
+	princeExtractRule_s rule = {startId, endId, 0, 0, palType, palEntryType, palEntryId};
+	return rule;
+}
+
+princeExtractRule_s Prince_ExternalPaletteRule(int startId, int endId, const unsigned char *palData, unsigned int palSize, int palType)
+{
+	princeExtractRule_s rule = {startId, endId, palData, palSize, palType, -1, -1};
+	return rule;
+}
+
+static int FindExtractRuleForId(const princeExtractRule_s *rules, int ruleCount, int id) //Returns index of the last rule covering id, or -1 if there's none
+{
+	for(int i = ruleCount - 1; i >= 0; i--)
+	{
+		if((rules[i].startId == -1 || id >= rules[i].startId) && (rules[i].endId == -1 || id <= rules[i].endId))
+			return i;
+	}
+	return -1;
+}
+
+bool Prince_ExtractDATv2(const char *path, const unsigned char *palData, unsigned int palSize, int palType, int startId, int endId, threadPool_s *pool)
+{
+	princeExtractRule_s rule = Prince_ExternalPaletteRule(startId, endId, palData, palSize, palType);
+	return Prince_ExtractDATv2Plan(path, &rule, 1, pool);
+}
+
+/*
+- Extracts everything in a POP2 DAT in one pass while following a list of rules defining which palette to use for which image ids
+- Entries that aren't covered by any rule are skipped (except palettes, as those are always extracted)
+- If several rules cover the same id, the last rule wins. This way a plan can start with a rule covering everything and then override palettes for specific ranges.
+- Rules without a palette use the first palette found in the DAT
+*/
+bool Prince_ExtractDATv2Plan(const char *path, const princeExtractRule_s *rules, int ruleCount, threadPool_s *pool)
 {
 	bool success = 1;
 
@@ -981,47 +1196,54 @@ bool Prince_ExtractDATv2(const char *path, unsigned char *palData, unsigned int
 	PathWithoutExt(path, pathWithoutExt);
 
 	int totalEntryCount = 0;
-	unsigned char *fileData = 0;
+	const unsigned char *fileData = 0; //Points into the mapped DAT
 	unsigned int fileDataSize = 0;
-	princeGenericPalette_s palette;
-	bool palLoaded = 0;
+	const princePalette_s *palette = 0; //Automatic palette (first one we find in the DAT)
+	const princePalette_s **rulePalettes = new const princePalette_s*[ruleCount]();
+	extractPipeline_s *output = 0;
 
-	if(palData)
+	princeDat_s *dat = Prince_OpenDATv2(path, &totalEntryCount);
+	if(dat)
 	{
-		Prince_ConvertPaletteToGeneric(&palette, palData, palSize, palType);
-		palLoaded = 1;
-	}
+		output = Pipeline_Create(pool);
+
+		//Prepare palettes defined by rules. If a palette can't be loaded, the rule falls back to the automatic palette.
+		for(int i = 0; i < ruleCount; i++)
+		{
+			const unsigned char *rulePalData = rules[i].palData;
+			unsigned int rulePalSize = rules[i].palSize;
+			if(rulePalData == 0 && rules[i].palEntryId != -1)
+			{
+				if(!Prince_LoadEntryPointerFromDATv2(dat, &rulePalData, &rulePalSize, rules[i].palEntryType, -1, rules[i].palEntryId))
+					rulePalData = 0;
+			}
+			if(rulePalData)
+				rulePalettes[i] = Prince_ConvertPalette(rulePalData, rulePalSize, rules[i].palType);
+		}
 
-	if(Prince_OpenDATv2(path, &totalEntryCount))
-	{
 		FILE *sequenceOutput = 0;
 		for(int type = POP2_DATFORMAT_UNKNOWN; type <= POP2_DATFORMAT_LEVEL; type++)
 		{
-			int entryCount = Prince_ReturnFileTypeCountFromDAT(type);
+			int entryCount = Prince_ReturnFileTypeCountFromDAT(dat, type);
 			for(int i = 0; i < entryCount; i++)
 			{
-				if(fileData)
-				{
-					delete[]fileData;
-					fileData = 0;
-				}
 				unsigned short id;
 				unsigned char flags[3];
-				if(!Prince_LoadEntryFromDATv2(&fileData, &fileDataSize, type, i, -1, &id, flags))
+				if(!Prince_LoadEntryPointerFromDATv2(dat, &fileData, &fileDataSize, type, i, -1, &id, flags))
 				{
 					success = 0;
 					break;
 				}
 
-				if(((startId != -1 && id < startId) || (endId != -1 && id > endId)) //If startId and endId are defined then we skip assets that don't match those IDs
+				int ruleIdx = FindExtractRuleForId(rules, ruleCount, id);
+				if(ruleIdx == -1 //We skip assets that aren't covered by any rule
 					&& type != POP2_DATFORMAT_CGA_PALETTE && type != POP2_DATFORMAT_SVGA_PALETTE && type != POP2_DATFORMAT_TGA_PALETTE && type != POP2_DATFORMAT_SHAPE_PALETTE) //However, we always allow loading of palletes
 					continue;
-
-				if(strstr(path, "TRANS.DAT") && id == 25381)
-				{
-					StatusUpdate("Warning: Skipping TRANS.DAT %u since it doesn't convert correctly.");
-					continue;
-				}
+				const princePalette_s *imgPalette = 0;
+				if(ruleIdx != -1 && rulePalettes[ruleIdx])
+					imgPalette = rulePalettes[ruleIdx];
+				else if(ruleIdx != -1)
+					imgPalette = palette;
 
 				const char *typeDir = 0;
 				if(type == POP2_DATFORMAT_UNKNOWN) typeDir = "Unknown";
@@ -1043,59 +1265,34 @@ bool Prince_ExtractDATv2(const char *path, unsigned char *palData, unsigned int
 				else if(type == POP2_DATFORMAT_LEVEL) typeDir = "Levels";
 				else typeDir = "Invalid";
 				char binPath[MAX_PATH];
-				sprintf_s(binPath, MAX_PATH, "%s\\%s\\res%u-%u-%u-%u.bin", pathWithoutExt, typeDir, id, flags[0], flags[1], flags[2]);
-				MakeDirectory_PathEndsWithFile(binPath);
-
-				FILE *file;
-				fopen_s(&file, binPath, "wb");
-				if(!file)
+				sprintf_s(binPath, MAX_PATH, "%s" PATHSEP "%s" PATHSEP "res%u-%u-%u-%u.bin", pathWithoutExt, typeDir, id, flags[0], flags[1], flags[2]);
+				if(!Pipeline_QueueFile(output, binPath, fileData, fileDataSize))
 				{
-					StatusUpdate("Warning: Failed to open %s for writing.", binPath);
 					success = 0;
 					break;
 				}
-				fwrite(fileData, fileDataSize, 1, file);
-				fclose(file);
-				StatusUpdate("Wrote %s", binPath);
 
-				if((type == POP2_DATFORMAT_SHAPE_PALETTE || type == POP2_DATFORMAT_SVGA_PALETTE || type == POP2_DATFORMAT_TGA_PALETTE) && !palLoaded) //Save palette so we can use it for image conversion
+				if((type == POP2_DATFORMAT_SHAPE_PALETTE || type == POP2_DATFORMAT_SVGA_PALETTE || type == POP2_DATFORMAT_TGA_PALETTE) && !palette) //Save palette so we can use it for image conversion
+					palette = Prince_ConvertPalette(fileData, fileDataSize, type);
+				else if(type == POP2_DATFORMAT_SHAPE && imgPalette && fileDataSize > sizeof(imgHeader_s) && ((const imgHeader_s *) fileData)->height != 0 && ((const imgHeader_s *) fileData)->width != 0 && ((const imgHeader_s *) fileData)->height <= 2048 && ((const imgHeader_s *) fileData)->width <= 2048)
 				{
-					Prince_ConvertPaletteToGeneric(&palette, fileData, fileDataSize, type);
-					palLoaded = 1;
-				}
-				else if(type == POP2_DATFORMAT_SHAPE && palLoaded && fileDataSize > sizeof(imgHeader_s) && ((imgHeader_s *) fileData)->height != 0 && ((imgHeader_s *) fileData)->width != 0 && ((imgHeader_s *) fileData)->height <= 2048 && ((imgHeader_s *) fileData)->width <= 2048)
-				{
-					unsigned char *newImgData = 0;
-					unsigned int newImgDataSize = 0, width = 0, height = 0;
-					unsigned char channels = 0;
-					if(!Prince_ConvPOPImageData(fileData, fileDataSize, &palette, &newImgData, &newImgDataSize, &width, &height, &channels))
+					//Convert to PNG
+					char imagePath[MAX_PATH];
+					sprintf_s(imagePath, MAX_PATH, "%s" PATHSEP "%s" PATHSEP "res%u-%u-%u-%u.%s", pathWithoutExt, typeDir, id, flags[0], flags[1], flags[2], ImageFormatExtension());
+					if(!Pipeline_QueueImage(output, imagePath, fileData, fileDataSize, imgPalette))
 					{
 						success = 0;
 						break;
 					}
-
-					//Convert to PNG
-					char pngPath[MAX_PATH];
-					sprintf_s(pngPath, MAX_PATH, "%s\\%s\\res%u-%u-%u-%u.png", pathWithoutExt, typeDir, id, flags[0], flags[1], flags[2]);
-					SaveImageAsPNG(pngPath, newImgData, width, height, channels);
-					delete[]newImgData;
 				}
 				else if(type == POP2_DATFORMAT_SOUND && fileDataSize > 4 && memcmp(&fileData[1], "MThd", 4) == 0) //This is a MIDI file
 				{
-					sprintf_s(binPath, MAX_PATH, "%s\\%s\\res%u-%u-%u-%u.mid", pathWithoutExt, typeDir, id, flags[0], flags[1], flags[2]);
-					MakeDirectory_PathEndsWithFile(binPath);
-
-					file = 0;
-					fopen_s(&file, binPath, "wb");
-					if(!file)
+					sprintf_s(binPath, MAX_PATH, "%s" PATHSEP "%s" PATHSEP "res%u-%u-%u-%u.mid", pathWithoutExt, typeDir, id, flags[0], flags[1], flags[2]);
+					if(!Pipeline_QueueFile(output, binPath, &fileData[1], fileDataSize - 1))
 					{
-						StatusUpdate("Warning: Failed to open %s for writing.", binPath);
 						success = 0;
 						break;
 					}
-					fwrite(&fileData[1], fileDataSize - 1, 1, file);
-					fclose(file);
-					StatusUpdate("Wrote %s", binPath);
 				}
 				else if(type == POP2_DATFORMAT_SEQUENCE)
 				{
@@ -1103,7 +1300,7 @@ bool Prince_ExtractDATv2(const char *path, unsigned char *palData, unsigned int
 					if(!sequenceOutput)
 					{
 						firstSeq = 1;
-						sprintf_s(binPath, MAX_PATH, "%s\\Sequences.txt", pathWithoutExt);
+						sprintf_s(binPath, MAX_PATH, "%s" PATHSEP "Sequences.txt", pathWithoutExt);
 						MakeDirectory_PathEndsWithFile(binPath);
 						fopen_s(&sequenceOutput, binPath, "wb");
 
@@ -1130,7 +1327,7 @@ bool Prince_ExtractDATv2(const char *path, unsigned char *palData, unsigned int
 						while(pos + 1 < fileDataSize)
 						{
 							fprintf(sequenceOutput, "\r\n");
-							short op = (short &) (fileData[pos]); pos += 2;							
+							short op = *(const short *) &fileData[pos]; pos += 2;							
 							switch(op)
 							{
 								case -63:
@@ -1160,7 +1357,7 @@ bool Prince_ExtractDATv2(const char *path, unsigned char *palData, unsigned int
 								}
 								case -24: //seq_ffe8_set_palette
 								{
-									short val = (short &) (fileData[pos]); pos += 2;
+									short val = *(const short *) &fileData[pos]; pos += 2;
 									fprintf(sequenceOutput, "SetPalette %i", val);
 									break;
 								}
@@ -1171,9 +1368,9 @@ bool Prince_ExtractDATv2(const char *path, unsigned char *palData, unsigned int
 								}
 								case -22: //seq_ffea_random_branch
 								{
-									short val = (short &) (fileData[pos]); pos += 2;
-									short val2 = (short &) (fileData[pos]); pos += 2;
-									short val3 = (short &) (fileData[pos]); pos += 2;
+									short val = *(const short *) &fileData[pos]; pos += 2;
+									short val2 = *(const short *) &fileData[pos]; pos += 2;
+									short val3 = *(const short *) &fileData[pos]; pos += 2;
 
 									//Write first part of command
 									fprintf(sequenceOutput, "RandomBranch %i", val);
@@ -1192,7 +1389,7 @@ bool Prince_ExtractDATv2(const char *path, unsigned char *palData, unsigned int
 								}
 								case -21: //seq_ffeb
 								{
-									short val = (short &) (fileData[pos]); pos += 2;
+									short val = *(const short *) &fileData[pos]; pos += 2;
 									fprintf(sequenceOutput, "SetSpecialState %i", val);
 									break;
 								}
@@ -1218,13 +1415,13 @@ bool Prince_ExtractDATv2(const char *path, unsigned char *palData, unsigned int
 								}
 								case -15: //seq_fff1_sound
 								{
-									short snd = (short &) (fileData[pos]); pos += 2;
+									short snd = *(const short *) &fileData[pos]; pos += 2;
 									fprintf(sequenceOutput, "PlaySoundPOP2 %i", snd);
 									break;
 								}
 								case -14: //seq_fff2_getitem
 								{
-									short item = (short &) (fileData[pos]); pos += 2;
+									short item = *(const short *) &fileData[pos]; pos += 2;
 									fprintf(sequenceOutput, "GetItem %i", item);
 									break;
 								}
@@ -1240,13 +1437,13 @@ bool Prince_ExtractDATv2(const char *path, unsigned char *palData, unsigned int
 								}
 								case -11: //seq_fff5
 								{
-									short val = (short &) (fileData[pos]); pos += 2;
+									short val = *(const short *) &fileData[pos]; pos += 2;
 									fprintf(sequenceOutput, "SetDeathType %i", val);
 									break;
 								}
 								case -10: //seq_fff6_jump_if_slow
 								{
-									short animId = (short &) (fileData[pos]); pos += 2;
+									short animId = *(const short *) &fileData[pos]; pos += 2;
 									const char *scriptName = PredefinedPOP2ScriptAnimName(animId);
 									if(scriptName)
 										fprintf(sequenceOutput, "Anim_IfFeather POP2_%03i_%s", animId, scriptName);
@@ -1256,21 +1453,21 @@ bool Prince_ExtractDATv2(const char *path, unsigned char *palData, unsigned int
 								}
 								case -9: //seq_fff7
 								{
-									short val = (short &) (fileData[pos]); pos += 2;
-									short val2 = (short &) (fileData[pos]); pos += 2;
+									short val = *(const short *) &fileData[pos]; pos += 2;
+									short val2 = *(const short *) &fileData[pos]; pos += 2;
 									fprintf(sequenceOutput, "AddMomentum %i %i", val, val2);
 									break;
 								}
 								case -8: //seq_fff8_setfall
 								{
-									short speed = (short &) (fileData[pos]); pos += 2;
-									short speed2 = (short &) (fileData[pos]); pos += 2;
+									short speed = *(const short *) &fileData[pos]; pos += 2;
+									short speed2 = *(const short *) &fileData[pos]; pos += 2;
 									fprintf(sequenceOutput, "SetFall %i %i", speed, speed2);
 									break;
 								}
 								case -7: //seq_fff9_action
 								{
-									short action = (short &) (fileData[pos]); pos += 2;
+									short action = *(const short *) &fileData[pos]; pos += 2;
 									if(action == 0) fprintf(sequenceOutput, "Action Stand");
 									else if(action == 1) fprintf(sequenceOutput, "Action RunJump");
 									else if(action == 2) fprintf(sequenceOutput, "Action HangClimb");
@@ -1287,13 +1484,13 @@ bool Prince_ExtractDATv2(const char *path, unsigned char *palData, unsigned int
 								}
 								case -6: //seq_fffa_dy
 								{
-									short val1 = (short &) (fileData[pos]); pos += 2;
+									short val1 = *(const short *) &fileData[pos]; pos += 2;
 									fprintf(sequenceOutput, "MoveY %i", val1);
 									break;
 								}
 								case -5: //seq_fffb_dx
 								{
-									short val1 = (short &) (fileData[pos]); pos += 2;
+									short val1 = *(const short *) &fileData[pos]; pos += 2;
 									fprintf(sequenceOutput, "MoveX %i", val1);
 									break;
 								}
@@ -1314,7 +1511,7 @@ bool Prince_ExtractDATv2(const char *path, unsigned char *palData, unsigned int
 								}
 								case -1: //seq_ffff_jump
 								{
-									short animId = (short &) (fileData[pos]); pos += 2;
+									short animId = *(const short *) &fileData[pos]; pos += 2;
 									const char *scriptName = PredefinedPOP2ScriptAnimName(animId);
 									if(scriptName)
 										fprintf(sequenceOutput, "Anim POP2_%03i_%s", animId, scriptName);
@@ -1334,19 +1531,27 @@ bool Prince_ExtractDATv2(const char *path, unsigned char *palData, unsigned int
 				}
 			}
 		}
+		if(!Pipeline_Finish(output)) //Has to happen before we close the DAT as queued data points into it
+			success = 0;
 		if(sequenceOutput)
 		{
 			fclose(sequenceOutput);
 			StatusUpdate("Wrote sequence script file.");
 		}
-		Prince_CloseDAT();
+		Prince_CloseDAT(dat);
 	}
 	else
 		success = 0;
 
 	//Finish
-	if(fileData)
-		delete[]fileData;
+	if(palette)
+		Prince_ReleasePalette(palette);
+	for(int i = 0; i < ruleCount; i++)
+	{
+		if(rulePalettes[i])
+			Prince_ReleasePalette(rulePalettes[i]);
+	}
+	delete[]rulePalettes;
 	return success;
 }
 
@@ -1388,7 +1593,7 @@ bool Prince_ReadPOP2FrameArrayData(char *path)
 
 	//Output binary data in text form
 	char outPath[MAX_PATH];
-	sprintf_s(outPath, MAX_PATH, "%s\\FrameArray.txt", pathWithoutExt);
+	sprintf_s(outPath, MAX_PATH, "%s" PATHSEP "FrameArray.txt", pathWithoutExt);
 	MakeDirectory_PathEndsWithFile(outPath);
 	FILE *file;
 	fopen_s(&file, outPath, "wb");
@@ -17,6 +17,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
 
+struct threadPool_s;
+
 enum
 {
 	//POP1 DAT formats (we have to guess these based on file data)
@@ -45,9 +47,48 @@ enum
 	POP2_DATFORMAT_LEVEL, //"\0\0\0\0"
 };
 
-void Prince_ConvertPaletteToGeneric(princeGenericPalette_s *genericPal, unsigned char *sourcePal, unsigned int sourcePalSize, int sourcePalType);
-int Prince_GuessDATFormat(unsigned char *data, unsigned int dataSize, bool isPalLoaded);
-bool Prince_ConvPOPImageData(unsigned char *srcImgData, unsigned int srcImgDataSize, princeGenericPalette_s *paletteData, unsigned char **rawImgData, unsigned int *rawImgDataSize, unsigned int *width, unsigned int *height, unsigned char *channels, bool flipY = 0);
-bool Prince_ExtractDAT(const char *path, unsigned char *palData = 0, unsigned int palSize = 0, int palType = 0);
-bool Prince_ExtractDATv2(const char *path, unsigned char *palData = 0, unsigned int palSize = 0, int palType = 0, int startId = -1, int endId = -1);
+#define POP1_MULTIPAL_VARIANTSIZE 48 //Every palette in a POP1 multipalette is 16 VGA colours, just like in a POP1 palette
+
+struct princeImageScratch_s //Reusable buffers for Prince_ConvPOPImageData(). Passing the same scratch for every image means we only allocate when an image is bigger than any before it.
+{
+	scratchBuffer_s intermediate; //Decompressed image data before it's converted to 8-bit
+	scratchBuffer_s indexed; //8-bit palettized image data
+	scratchBuffer_s output; //Final RGBA image data (or palette indices from Prince_DecodePOPImageIndices())
+};
+
+struct princeIndexedImage_s //Image decoded to 8-bit palette indices once, so it can be rendered under any palette without decompressing it again
+{
+	unsigned char *indices;
+	unsigned int width;
+	unsigned int height;
+	unsigned int colourCount; //Palette entries the image can refer to
+	unsigned int decodedPixels; //Pixels the image data covered (in row order). The rest stay fully transparent under every palette
+};
+
+struct princeExtractRule_s //Defines which palette to use for images within an id range when extracting a POP2 DAT
+{
+	int startId; //-1 for no lower bound
+	int endId; //-1 for no upper bound
+	const unsigned char *palData; //Palette supplied by the caller (null if the palette comes from the DAT or if we should use the automatic palette)
+	unsigned int palSize;
+	int palType; //Format of the palette data
+	int palEntryType; //If palData is null and palEntryId isn't -1, then the palette is loaded from the DAT itself using this type and id
+	int palEntryId;
+};
+
+const princePalette_s *Prince_ConvertPalette(const unsigned char *sourcePal, unsigned int sourcePalSize, int sourcePalType, unsigned int sourcePalOffset = 0); //Returns the shared compiled palette for this palette data. Release it with Prince_ReleasePalette(). sourcePalOffset skips that many bytes at the start of the palette data. Use multiples of POP1_MULTIPAL_VARIANTSIZE to pick one of the palettes in a POP1 multipalette
+int Prince_GuessDATFormat(const unsigned char *data, unsigned int dataSize, bool isPalLoaded);
+bool Prince_ConvPOPImageData(const unsigned char *srcImgData, unsigned int srcImgDataSize, const princePalette_s *paletteData, unsigned char **rawImgData, unsigned int *rawImgDataSize, unsigned int *width, unsigned int *height, unsigned char *channels, bool flipY = 0, princeImageScratch_s *scratch = 0);
+bool Prince_DecodePOPImageIndices(const unsigned char *srcImgData, unsigned int srcImgDataSize, unsigned char **indexData, unsigned int *width, unsigned int *height, unsigned int *colourCount, bool flipY = 0, princeImageScratch_s *scratch = 0);
+bool Prince_DecodeIndexedImage(const unsigned char *srcImgData, unsigned int srcImgDataSize, princeIndexedImage_s *image, princeImageScratch_s *scratch = 0);
+bool Prince_RenderIndexedImage(const princeIndexedImage_s *image, const princePalette_s *paletteData, unsigned char **rawImgData, unsigned int *rawImgDataSize, unsigned char *channels, princeImageScratch_s *scratch = 0);
+void Prince_FreeIndexedImage(princeIndexedImage_s *image);
+void Prince_FreeImageScratch(princeImageScratch_s *scratch);
+bool Prince_ExtractDAT(const char *path, const unsigned char *palData = 0, unsigned int palSize = 0, int palType = 0, threadPool_s *pool = 0);
+void Prince_ExtractAllPaletteVariants(bool enable); //POP1 DATs extracted with a multipalette get every image once for each palette in it (each in its own Variant folder) instead of only with the first palette
+princeExtractRule_s Prince_AutoPaletteRule(int startId = -1, int endId = -1);
+princeExtractRule_s Prince_DATPaletteRule(int startId, int endId, int palEntryType, int palEntryId, int palType);
+princeExtractRule_s Prince_ExternalPaletteRule(int startId, int endId, const unsigned char *palData, unsigned int palSize, int palType);
+bool Prince_ExtractDATv2(const char *path, const unsigned char *palData = 0, unsigned int palSize = 0, int palType = 0, int startId = -1, int endId = -1, threadPool_s *pool = 0);
+bool Prince_ExtractDATv2Plan(const char *path, const princeExtractRule_s *rules, int ruleCount, threadPool_s *pool = 0); //If pool is defined, images are converted on the pool
 bool Prince_ReadPOP2FrameArrayData(char *path);
\ No newline at end of file
@@ -15,33 +15,355 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
-#include <windows.h>
 #include <stdio.h>
-#include <tchar.h>
 #include <stdlib.h>
+#include <atomic>
+#include "Platform.h"
 #include "Misc.h"
 #include "Vars.h"
 #include "DAT.h"
 #include "DAT-Formats.h"
 
-//TODO: We should make it possible for the LoadEntry functions to return entry type. Might be useful when it comes to palettes
+#define DAT_TYPECOUNT (POP2_DATFORMAT_LEVEL + 1)
+#define DAT_INDEX_EMPTYKEY 0xFFFFFFFF
+#define DAT_INDEXCACHE_VERSION 1
 
 struct entryList_s
 {
 	int type;
-	datFooterEntryV2_s *entries;
+	datFooterEntryV2_s *entries; //Points into the index cache (and is read-only) if the DAT was opened with one
 	unsigned short entryCount;
+	const unsigned char *checksumStatus; //One per entry, 1 if the checksum byte matches the entry's data and 0 if not. Only known when the DAT was opened with an index cache
 };
 
-struct datContext_s
+struct entryIndexSlot_s //Slot in an open addressing hash table used to find entries based on id
 {
-	FILE *file;
+	unsigned int key; //Entry id, or (type << 16) | id for the type index. DAT_INDEX_EMPTYKEY if slot is unused.
+	unsigned short listIdx;
+	unsigned short entryIdx;
+};
+
+struct entryIndex_s
+{
+	entryIndexSlot_s *slots;
+	unsigned int mask; //Slot count minus one (slot count is always a power of two)
+};
+
+#pragma pack(push, 1)
+struct datIndexCacheHeader_s //Start of a "<DAT>.idx" file, which holds everything Prince_OpenDATv2() works out from a DAT so it doesn't have to parse it again
+{
+	char magic[4]; //"PIDX"
+	unsigned int version;
+	unsigned long long datSize; //Size and modification time of the DAT when the index was written. The index is rebuilt if either has changed
+	unsigned long long datModifiedTime;
+	unsigned int totalFileCount;
+	unsigned int typeIndexSlotCount;
+	unsigned int idIndexSlotCount;
+	unsigned short entryListCount;
+	unsigned short padding;
+	//Followed by typeIndexSlotCount entryIndexSlot_s, idIndexSlotCount entryIndexSlot_s, entryListCount datIndexCacheList_s, totalFileCount datFooterEntryV2_s (list by list) and totalFileCount checksum status bytes
+};
+
+struct datIndexCacheList_s
+{
+	int type;
+	unsigned short entryCount;
+	unsigned short padding;
+};
+#pragma pack(pop)
+
+//The lookup tables are used straight from the mapped index, so everything before the entries has to keep them 4-byte aligned
+static_assert(sizeof(datIndexCacheHeader_s) % 8 == 0, "datIndexCacheHeader_s has to keep the index tables aligned");
+static_assert(sizeof(entryIndexSlot_s) == 8, "entryIndexSlot_s is stored as-is in index caches");
+static_assert(sizeof(datIndexCacheList_s) == 8, "datIndexCacheList_s has to keep the index tables aligned");
+
+static bool useIndexCache = 0;
+static std::atomic<unsigned int> indexCacheWriteCount(0); //Keeps temporary file names unique when several threads write index caches
+
+struct princeDat_s
+{
+	mappedFile_s mappedFile; //The whole DAT is mapped into memory when it's opened, and entries are served as pointers into it
+	mappedFile_s indexFile; //Index cache the entry lists and lookup tables point into (if the DAT was opened with one)
 	entryList_s *entryLists;
 	unsigned short entryListCount;
-	unsigned long totalFileCount;
+	unsigned int totalFileCount;
+	short typeListIdx[DAT_TYPECOUNT]; //First entry list for each type (-1 if DAT has no list of that type)
+	entryIndex_s typeIndex; //Finds entry based on type and id
+	entryIndex_s idIndex; //Finds entry based on id alone (if several entries share an id, the first one in the DAT wins)
 };
 
-static datContext_s datContext = {0, 0, 0, 0};
+//Returns pointer to a structure within the mapped DAT, or null if it'd go past the end of the file
+static const unsigned char *DATPointer(princeDat_s *dat, unsigned long long offset, unsigned long long size)
+{
+	if(offset + size > dat->mappedFile.size)
+		return 0;
+	return dat->mappedFile.data + offset;
+}
+
+//Returns true if the entry's checksum byte and data end before dataEnd and within the mapped DAT. Summed in 64 bits so offsets near the 32-bit limit can't wrap around
+static bool EntryIsInBounds(princeDat_s *dat, const datFooterEntryV2_s *entry, unsigned long long dataEnd)
+{
+	unsigned long long entryEnd = (unsigned long long) entry->offset + entry->size + 1; //We add one byte to compensate for checksum byte that exists for each file entry within a DAT
+	return entryEnd <= dataEnd && entryEnd <= dat->mappedFile.size;
+}
+
+//Entries' checksum bytes are set so that the checksum byte plus every byte of data adds up to 0xFF
+static bool EntryChecksumIsValid(princeDat_s *dat, const datFooterEntryV2_s *entry)
+{
+	const unsigned char *entryData = dat->mappedFile.data + entry->offset;
+	unsigned char entrySum = 0;
+	for(unsigned int k = 0; k <= entry->size; k++)
+		entrySum += entryData[k];
+	return entrySum == 0xFF;
+}
+
+static princeDat_s *AllocDATHandle()
+{
+	princeDat_s *dat = new princeDat_s;
+	memset(dat, 0, sizeof(princeDat_s));
+	for(int i = 0; i < DAT_TYPECOUNT; i++)
+		dat->typeListIdx[i] = -1;
+	return dat;
+}
+
+static inline unsigned int IndexHash(unsigned int key)
+{
+	return key * 2654435761u; //Knuth's multiplicative hash
+}
+
+static void InitEntryIndex(entryIndex_s *index, unsigned int entryCount)
+{
+	unsigned int slotCount = 16;
+	while(slotCount < entryCount * 2) //Keep load factor at or below 50%
+		slotCount <<= 1;
+	index->slots = new entryIndexSlot_s[slotCount];
+	index->mask = slotCount - 1;
+	memset(index->slots, 0, sizeof(entryIndexSlot_s) * slotCount); //Empty slots are written to the index cache as well, so don't leave anything uninitialised in them
+	for(unsigned int i = 0; i < slotCount; i++)
+		index->slots[i].key = DAT_INDEX_EMPTYKEY;
+}
+
+static void InsertIntoEntryIndex(entryIndex_s *index, unsigned int key, unsigned short listIdx, unsigned short entryIdx) //Doesn't overwrite existing keys, so the first entry inserted with a key is the one we find later
+{
+	unsigned int slot = IndexHash(key) & index->mask;
+	while(index->slots[slot].key != DAT_INDEX_EMPTYKEY)
+	{
+		if(index->slots[slot].key == key)
+			return;
+		slot = (slot + 1) & index->mask;
+	}
+	index->slots[slot].key = key;
+	index->slots[slot].listIdx = listIdx;
+	index->slots[slot].entryIdx = entryIdx;
+}
+
+static const entryIndexSlot_s *FindInEntryIndex(const entryIndex_s *index, unsigned int key)
+{
+	if(index->slots == 0)
+		return 0;
+	unsigned int slot = IndexHash(key) & index->mask;
+	while(index->slots[slot].key != DAT_INDEX_EMPTYKEY)
+	{
+		if(index->slots[slot].key == key)
+			return &index->slots[slot];
+		slot = (slot + 1) & index->mask;
+	}
+	return 0;
+}
+
+static void BuildEntryIndices(princeDat_s *dat) //Called once the entry lists have been read and validated
+{
+	InitEntryIndex(&dat->typeIndex, dat->totalFileCount);
+	InitEntryIndex(&dat->idIndex, dat->totalFileCount);
+	for(unsigned short j = 0; j < dat->entryListCount; j++)
+	{
+		int type = dat->entryLists[j].type;
+		if(dat->typeListIdx[type] == -1)
+			dat->typeListIdx[type] = j;
+		bool firstListOfType = dat->typeListIdx[type] == j; //Loading by type only ever looks at the first list of that type
+		for(unsigned short i = 0; i < dat->entryLists[j].entryCount; i++)
+		{
+			unsigned short id = dat->entryLists[j].entries[i].id;
+			if(firstListOfType)
+				InsertIntoEntryIndex(&dat->typeIndex, (type << 16) | id, j, i);
+			InsertIntoEntryIndex(&dat->idIndex, id, j, i);
+		}
+	}
+}
+
+void Prince_UseDATIndexCache(bool enable)
+{
+	useIndexCache = enable;
+}
+
+static bool EntryIndexIsValid(princeDat_s *dat, const entryIndex_s *index, bool isTypeIndex) //Checks that every used slot points at an entry with the slot's key, and that there's an empty slot so lookups of missing keys stop
+{
+	bool foundEmptySlot = 0;
+	for(unsigned int i = 0; i <= index->mask; i++)
+	{
+		const entryIndexSlot_s *slot = &index->slots[i];
+		if(slot->key == DAT_INDEX_EMPTYKEY)
+		{
+			foundEmptySlot = 1;
+			continue;
+		}
+		if(slot->listIdx >= dat->entryListCount || slot->entryIdx >= dat->entryLists[slot->listIdx].entryCount)
+			return 0;
+		const entryList_s *list = &dat->entryLists[slot->listIdx];
+		unsigned int id = list->entries[slot->entryIdx].id;
+		if(isTypeIndex && (slot->key != (((unsigned int) list->type << 16) | id) || dat->typeListIdx[list->type] != slot->listIdx))
+			return 0;
+		if(!isTypeIndex && slot->key != id)
+			return 0;
+	}
+	return foundEmptySlot;
+}
+
+static bool OpenDATIndexCache(princeDat_s *dat, const char *indexPath, unsigned long long datSize, unsigned long long datModifiedTime) //Points the entry lists and lookup tables at the index cache if it's valid for this DAT. Fails quietly otherwise so the caller can parse the DAT instead
+{
+	const datHeader_s *datHeader = (const datHeader_s *) DATPointer(dat, 0, sizeof(datHeader_s));
+	if(datHeader == 0)
+		return 0;
+	mappedFile_s indexFile;
+	if(!MapFileForReading(indexPath, &indexFile))
+		return 0;
+	const datIndexCacheHeader_s *header = (const datIndexCacheHeader_s *) indexFile.data;
+	unsigned long long expectedSize = 0;
+	if(indexFile.size >= sizeof(datIndexCacheHeader_s))
+		expectedSize = sizeof(datIndexCacheHeader_s) + sizeof(entryIndexSlot_s) * ((unsigned long long) header->typeIndexSlotCount + header->idIndexSlotCount) + sizeof(datIndexCacheList_s) * header->entryListCount + (sizeof(datFooterEntryV2_s) + 1) * (unsigned long long) header->totalFileCount;
+	if(expectedSize == 0 || indexFile.size != expectedSize || memcmp(header->magic, "PIDX", 4) != 0 || header->version != DAT_INDEXCACHE_VERSION || header->datSize != datSize || header->datModifiedTime != datModifiedTime
+		|| header->typeIndexSlotCount < 16 || (header->typeIndexSlotCount & (header->typeIndexSlotCount - 1)) != 0 || header->idIndexSlotCount < 16 || (header->idIndexSlotCount & (header->idIndexSlotCount - 1)) != 0)
+	{
+		UnmapFile(&indexFile);
+		return 0;
+	}
+
+	//Check the entry lists add up before we use them
+	entryIndexSlot_s *typeSlots = (entryIndexSlot_s *) (indexFile.data + sizeof(datIndexCacheHeader_s));
+	entryIndexSlot_s *idSlots = typeSlots + header->typeIndexSlotCount;
+	const datIndexCacheList_s *lists = (const datIndexCacheList_s *) (idSlots + header->idIndexSlotCount);
+	unsigned int entryCount = 0;
+	for(unsigned short j = 0; j < header->entryListCount; j++)
+	{
+		if(lists[j].type < 0 || lists[j].type >= DAT_TYPECOUNT)
+		{
+			UnmapFile(&indexFile);
+			return 0;
+		}
+		entryCount += lists[j].entryCount;
+	}
+	if(entryCount != header->totalFileCount)
+	{
+		UnmapFile(&indexFile);
+		return 0;
+	}
+
+	//Point the handle at the index
+	datFooterEntryV2_s *entries = (datFooterEntryV2_s *) (lists + header->entryListCount);
+	const unsigned char *checksumStatus = (const unsigned char *) (entries + header->totalFileCount);
+	dat->indexFile = indexFile;
+	dat->entryListCount = header->entryListCount;
+	dat->totalFileCount = header->totalFileCount;
+	dat->entryLists = new entryList_s[header->entryListCount];
+	for(unsigned short j = 0; j < header->entryListCount; j++)
+	{
+		dat->entryLists[j].type = lists[j].type;
+		dat->entryLists[j].entryCount = lists[j].entryCount;
+		dat->entryLists[j].entries = entries;
+		dat->entryLists[j].checksumStatus = checksumStatus;
+		entries += lists[j].entryCount;
+		checksumStatus += lists[j].entryCount;
+		if(dat->typeListIdx[lists[j].type] == -1)
+			dat->typeListIdx[lists[j].type] = j;
+	}
+	dat->typeIndex.slots = typeSlots;
+	dat->typeIndex.mask = header->typeIndexSlotCount - 1;
+	dat->idIndex.slots = idSlots;
+	dat->idIndex.mask = header->idIndexSlotCount - 1;
+
+	//The index could still be corrupt or written for other DAT content with the same size and time, so check entries and lookup tables the same way as when we parse the DAT
+	bool valid = EntryIndexIsValid(dat, &dat->typeIndex, 1) && EntryIndexIsValid(dat, &dat->idIndex, 0);
+	for(unsigned short j = 0; j < dat->entryListCount && valid; j++)
+	{
+		for(unsigned short i = 0; i < dat->entryLists[j].entryCount && valid; i++)
+			valid = EntryIsInBounds(dat, &dat->entryLists[j].entries[i], datHeader->footerOffset);
+	}
+	if(!valid)
+	{
+		delete[]dat->entryLists;
+		dat->entryLists = 0;
+		dat->entryListCount = 0;
+		dat->totalFileCount = 0;
+		for(int i = 0; i < DAT_TYPECOUNT; i++)
+			dat->typeListIdx[i] = -1;
+		memset(&dat->typeIndex, 0, sizeof(entryIndex_s));
+		memset(&dat->idIndex, 0, sizeof(entryIndex_s));
+		UnmapFile(&dat->indexFile);
+		return 0;
+	}
+	return 1;
+}
+
+static void WriteDATIndexCache(princeDat_s *dat, const char *indexPath, unsigned long long datSize, unsigned long long datModifiedTime) //Called once the DAT has been parsed and its lookup tables are built
+{
+	//Build the whole index in memory so it's written with one call
+	datIndexCacheHeader_s header;
+	memset(&header, 0, sizeof(datIndexCacheHeader_s));
+	memcpy(header.magic, "PIDX", 4);
+	header.version = DAT_INDEXCACHE_VERSION;
+	header.datSize = datSize;
+	header.datModifiedTime = datModifiedTime;
+	header.totalFileCount = dat->totalFileCount;
+	header.typeIndexSlotCount = dat->typeIndex.mask + 1;
+	header.idIndexSlotCount = dat->idIndex.mask + 1;
+	header.entryListCount = dat->entryListCount;
+	size_t indexSize = sizeof(datIndexCacheHeader_s) + sizeof(entryIndexSlot_s) * (header.typeIndexSlotCount + header.idIndexSlotCount) + sizeof(datIndexCacheList_s) * header.entryListCount + (sizeof(datFooterEntryV2_s) + 1) * header.totalFileCount;
+	unsigned char *indexData = new unsigned char[indexSize];
+	unsigned char *pos = indexData;
+	memcpy(pos, &header, sizeof(datIndexCacheHeader_s));
+	pos += sizeof(datIndexCacheHeader_s);
+	memcpy(pos, dat->typeIndex.slots, sizeof(entryIndexSlot_s) * header.typeIndexSlotCount);
+	pos += sizeof(entryIndexSlot_s) * header.typeIndexSlotCount;
+	memcpy(pos, dat->idIndex.slots, sizeof(entryIndexSlot_s) * header.idIndexSlotCount);
+	pos += sizeof(entryIndexSlot_s) * header.idIndexSlotCount;
+	for(unsigned short j = 0; j < dat->entryListCount; j++)
+	{
+		datIndexCacheList_s list;
+		memset(&list, 0, sizeof(datIndexCacheList_s));
+		list.type = dat->entryLists[j].type;
+		list.entryCount = dat->entryLists[j].entryCount;
+		memcpy(pos, &list, sizeof(datIndexCacheList_s));
+		pos += sizeof(datIndexCacheList_s);
+	}
+	for(unsigned short j = 0; j < dat->entryListCount; j++)
+	{
+		memcpy(pos, dat->entryLists[j].entries, sizeof(datFooterEntryV2_s) * dat->entryLists[j].entryCount);
+		pos += sizeof(datFooterEntryV2_s) * dat->entryLists[j].entryCount;
+	}
+	for(unsigned short j = 0; j < dat->entryListCount; j++)
+	{
+		for(unsigned short i = 0; i < dat->entryLists[j].entryCount; i++)
+		{
+			*pos = EntryChecksumIsValid(dat, &dat->entryLists[j].entries[i]);
+			pos++;
+		}
+	}
+
+	//Write it to a temporary file and then move it into place, so other processes never see a partly written index (or have one truncated while they're using it)
+	char tempPath[MAX_PATH];
+	sprintf_s(tempPath, MAX_PATH, "%s.%i-%u.tmp", indexPath, _getpid(), indexCacheWriteCount++);
+	FILE *file;
+	fopen_s(&file, tempPath, "wb");
+	bool written = file && fwrite(indexData, indexSize, 1, file) == 1;
+	if(file)
+		fclose(file);
+	if(!written || !RenameFile(tempPath, indexPath)) //This is only a cache, so failing isn't fatal
+	{
+		StatusUpdate("Warning: Failed to write index cache %s", indexPath);
+		remove(tempPath);
+	}
+	delete[]indexData;
+}
 
 static int DefineTypeBasedOnMagic(char *magic)
 {
@@ -64,159 +386,186 @@ static int DefineTypeBasedOnMagic(char *magic)
 	else return POP2_DATFORMAT_UNKNOWN;
 }
 
-bool Prince_OpenDAT(const char *path, int *entryCount)
+princeDat_s *Prince_OpenDAT(const char *path, int *entryCount)
 {
 	if(entryCount)
 		*entryCount = 0;
-	if(datContext.file != 0 || datContext.entryLists != 0)
+
+	//Map DAT file
+	princeDat_s *dat = AllocDATHandle();
+	if(!MapFileForReading(path, &dat->mappedFile))
 	{
-		StatusUpdate("Warning: Failed to load %s because we already have active pointers in datContext", path);
+		StatusUpdate("Warning: Failed to load %s", path);
+		delete dat;
 		return 0;
 	}
 
-	//Open DAT file
-	fopen_s(&datContext.file, path, "rb");
-	if(datContext.file == 0)
+	//Read header and footer
+	const datHeader_s *header = (const datHeader_s *) DATPointer(dat, 0, sizeof(datHeader_s));
+	const datFooter_s *footer = header ? (const datFooter_s *) DATPointer(dat, header->footerOffset, sizeof(datFooter_s)) : 0;
+	const datFooterEntry_s *intermediateList = footer ? (const datFooterEntry_s *) DATPointer(dat, header->footerOffset + sizeof(datFooter_s), (unsigned long long) sizeof(datFooterEntry_s) * footer->entryCount) : 0;
+	if(intermediateList == 0)
 	{
-		StatusUpdate("Warning: Failed to load %s", path);
+		StatusUpdate("Warning: Header or footer is invalid in DAT %s", path);
+		UnmapFile(&dat->mappedFile);
+		delete dat;
 		return 0;
 	}
 
-	//Read header
-	datHeader_s header;
-	fread(&header, sizeof(datHeader_s), 1, datContext.file);
-	fseek(datContext.file, header.footerOffset, SEEK_SET);
-
-	//Read footer and entry list
-	datFooter_s footer;
-	fread(&footer, sizeof(datFooter_s), 1, datContext.file);
-	datContext.entryListCount = 1;
-	datContext.totalFileCount = footer.entryCount;
-	datContext.entryLists = new entryList_s[1];
-	datContext.entryLists[0].entryCount = footer.entryCount;
-	datContext.entryLists[0].type = POP1_DATFORMAT_BIN;
+	//Read entry list
+	dat->entryListCount = 1;
+	dat->totalFileCount = footer->entryCount;
+	dat->entryLists = new entryList_s[1];
+	dat->entryLists[0].entryCount = footer->entryCount;
+	dat->entryLists[0].type = POP1_DATFORMAT_BIN;
+	dat->entryLists[0].checksumStatus = 0;
 
 	//We store entry list in the same format as POP2, but POP1 has a slightly different format, so we read in the POP1 format and then convert it to the POP2 format
-	datFooterEntry_s *intermediateList  = new datFooterEntry_s[footer.entryCount];
-	fread(intermediateList, sizeof(datFooterEntry_s), footer.entryCount, datContext.file);
-	datContext.entryLists[0].entries = new datFooterEntryV2_s[footer.entryCount];
-	for(unsigned short i = 0; i < footer.entryCount; i++)
+	dat->entryLists[0].entries = new datFooterEntryV2_s[footer->entryCount];
+	for(unsigned short i = 0; i < footer->entryCount; i++)
 	{
-		datContext.entryLists[0].entries[i].id = intermediateList[i].id;
-		datContext.entryLists[0].entries[i].offset = intermediateList[i].offset;
-		datContext.entryLists[0].entries[i].size = intermediateList[i].size;
-		memcpy(datContext.entryLists[0].entries[i].flags, "\0\0\0", 3);
+		dat->entryLists[0].entries[i].id = intermediateList[i].id;
+		dat->entryLists[0].entries[i].offset = intermediateList[i].offset;
+		dat->entryLists[0].entries[i].size = intermediateList[i].size;
+		memcpy(dat->entryLists[0].entries[i].flags, "\0\0\0", 3);
 	}
-	delete[]intermediateList;
 
 	//DAT has been succcesfully loaded, but let's do a quick error check to verify the entry list looks okay
-	for(int i = 0; i < datContext.entryLists[0].entryCount; i++)
+	for(int i = 0; i < dat->entryLists[0].entryCount; i++)
 	{
-		if(datContext.entryLists[0].entries[i].offset + datContext.entryLists[0].entries[i].size + 1 > header.footerOffset) //We add one byte to compensate for checksum byte that exists for each file entry within a DAT
+		if(!EntryIsInBounds(dat, &dat->entryLists[0].entries[i], header->footerOffset))
 		{
 			StatusUpdate("Warning: Entry %u offset or size is invalid in DAT %s", i, path);
-			Prince_CloseDAT();
+			Prince_CloseDAT(dat);
 			return 0;
 		}
 	}
 
+	BuildEntryIndices(dat);
+
 	//Finish
 	if(entryCount)
-		*entryCount = datContext.totalFileCount;
-	return 1;
+		*entryCount = dat->totalFileCount;
+	return dat;
 }
 
-bool Prince_OpenDATv2(const char *path, int *entryCount)
+princeDat_s *Prince_OpenDATv2(const char *path, int *entryCount)
 {
 	if(entryCount)
 		*entryCount = 0;
-	if(datContext.file != 0 || datContext.entryLists != 0)
-	{
-		StatusUpdate("Warning: Failed to load %s because we already have active pointers in datContext", path);
-		return 0;
-	}
 
-	//Open DAT file
-	fopen_s(&datContext.file, path, "rb");
-	if(datContext.file == 0)
+	//The index cache is only trusted if the DAT's size and modification time haven't changed since it was written
+	char indexPath[MAX_PATH];
+	unsigned long long datSize = 0, datModifiedTime = 0;
+	bool indexCacheUsable = useIndexCache && GetFileSizeAndModifiedTime(path, &datSize, &datModifiedTime);
+	if(indexCacheUsable)
+		sprintf_s(indexPath, MAX_PATH, "%s.idx", path);
+
+	//Map DAT file
+	princeDat_s *dat = AllocDATHandle();
+	if(!MapFileForReading(path, &dat->mappedFile))
 	{
 		StatusUpdate("Warning: Failed to load %s", path);
+		delete dat;
 		return 0;
 	}
 
-	//Read header
-	datHeader_s header;
-	fread(&header, sizeof(datHeader_s), 1, datContext.file);
-	fseek(datContext.file, header.footerOffset, SEEK_SET);
-
-	//Read master index
-	datMasterIndex_s masterIndex;
-	fread(&masterIndex, sizeof(datMasterIndex_s), 1, datContext.file);
+	//If we have a valid index cache, there's nothing to parse
+	if(indexCacheUsable && dat->mappedFile.size == datSize && OpenDATIndexCache(dat, indexPath, datSize, datModifiedTime))
+	{
+		if(entryCount)
+			*entryCount = dat->totalFileCount;
+		return dat;
+	}
 
-	//Read in footer headers
-	datFooterHeader_s *footerHeaders = new datFooterHeader_s[masterIndex.footerCount]; //This gets freed later in this function
-	fread(footerHeaders, sizeof(datFooterHeader_s), masterIndex.footerCount, datContext.file);
+	//Read header, master index, and footer headers
+	const datHeader_s *header = (const datHeader_s *) DATPointer(dat, 0, sizeof(datHeader_s));
+	const datMasterIndex_s *masterIndex = header ? (const datMasterIndex_s *) DATPointer(dat, header->footerOffset, sizeof(datMasterIndex_s)) : 0;
+	const datFooterHeader_s *footerHeaders = masterIndex ? (const datFooterHeader_s *) DATPointer(dat, header->footerOffset + sizeof(datMasterIndex_s), (unsigned long long) sizeof(datFooterHeader_s) * masterIndex->footerCount) : 0;
+	if(footerHeaders == 0)
+	{
+		StatusUpdate("Warning: Header or master index is invalid in DAT %s", path);
+		UnmapFile(&dat->mappedFile);
+		delete dat;
+		return 0;
+	}
 
 	//Read in every entry list
-	datContext.entryLists = new entryList_s[masterIndex.footerCount];
-	datContext.entryListCount = masterIndex.footerCount;
-	datContext.totalFileCount = 0;
-	for(int i = 0; i < masterIndex.footerCount; i++)
+	dat->entryLists = new entryList_s[masterIndex->footerCount];
+	memset(dat->entryLists, 0, sizeof(entryList_s) * masterIndex->footerCount);
+	dat->entryListCount = masterIndex->footerCount;
+	dat->totalFileCount = 0;
+	for(int i = 0; i < masterIndex->footerCount; i++)
 	{
-		datContext.entryLists[i].type = DefineTypeBasedOnMagic(footerHeaders[i].magic);
-		fseek(datContext.file, header.footerOffset + footerHeaders[i].footerOffset, SEEK_SET);
+		dat->entryLists[i].type = DefineTypeBasedOnMagic((char *) footerHeaders[i].magic);
 
-		//Read footer
-		datFooter_s footer;
-		fread(&footer, sizeof(datFooter_s), 1, datContext.file);
+		//Read footer and entry list
+		unsigned long long footerOffset = (unsigned long long) header->footerOffset + footerHeaders[i].footerOffset;
+		const datFooter_s *footer = (const datFooter_s *) DATPointer(dat, footerOffset, sizeof(datFooter_s));
+		const datFooterEntryV2_s *entries = footer ? (const datFooterEntryV2_s *) DATPointer(dat, footerOffset + sizeof(datFooter_s), (unsigned long long) sizeof(datFooterEntryV2_s) * footer->entryCount) : 0;
+		if(entries == 0)
+		{
+			StatusUpdate("Warning: Footer %u is invalid in DAT %s", i, path);
+			Prince_CloseDAT(dat);
+			return 0;
+		}
 
 		//Update entry counts
-		datContext.entryLists[i].entryCount = footer.entryCount;
-		datContext.totalFileCount += footer.entryCount;
+		dat->entryLists[i].entryCount = footer->entryCount;
+		dat->totalFileCount += footer->entryCount;
 		
-		//Read entry list
-		datContext.entryLists[i].entries = new datFooterEntryV2_s[footer.entryCount];
-		fread(datContext.entryLists[i].entries, sizeof(datFooterEntryV2_s), footer.entryCount, datContext.file);
+		//Copy entry list
+		dat->entryLists[i].entries = new datFooterEntryV2_s[footer->entryCount];
+		memcpy(dat->entryLists[i].entries, entries, sizeof(datFooterEntryV2_s) * footer->entryCount);
 	}
-	delete[]footerHeaders;
 
 	//DAT has been succcesfully loaded, but let's do a quick error check to verify the entry lists look okay
-	for(int j = 0; j < datContext.entryListCount; j++)
+	for(int j = 0; j < dat->entryListCount; j++)
 	{
-		for(int i = 0; i < datContext.entryLists[j].entryCount; i++)
+		for(int i = 0; i < dat->entryLists[j].entryCount; i++)
 		{
-			if(datContext.entryLists[j].entries[i].offset + datContext.entryLists[j].entries[i].size + 1 > header.footerOffset) //We add one byte to compensate for checksum byte that exists for each file entry within a DAT
+			if(!EntryIsInBounds(dat, &dat->entryLists[j].entries[i], header->footerOffset))
 			{
 				StatusUpdate("Warning: Entry %u/%u offset or size is invalid in DAT %s", j, i, path);
-				Prince_CloseDAT();
+				Prince_CloseDAT(dat);
 				return 0;
 			}
 		}
 	}
 
+	BuildEntryIndices(dat);
+	if(indexCacheUsable && dat->mappedFile.size == datSize)
+		WriteDATIndexCache(dat, indexPath, datSize, datModifiedTime);
+
 	//Finish
 	if(entryCount)
-		*entryCount = datContext.totalFileCount;
-	return 1;
+		*entryCount = dat->totalFileCount;
+	return dat;
 }
 
-bool Prince_CloseDAT() //This can be used to close v1 and v2 DAT files
+bool Prince_CloseDAT(princeDat_s *dat) //This can be used to close v1 and v2 DAT files
 {
-	if(datContext.file == 0 || datContext.entryLists == 0)
+	if(dat == 0)
 	{
-		StatusUpdate("Warning: Failed to close DAT file because of missing pointers in datContext");
+		StatusUpdate("Warning: Failed to close DAT file because the DAT handle is null");
 		return 0;
 	}
-	fclose(datContext.file);
-	for(int i = 0; i < datContext.entryListCount; i++)
-		delete[]datContext.entryLists[i].entries;
-	datContext.file = 0;
-	delete[]datContext.entryLists;
-	datContext.entryLists = 0;
+	UnmapFile(&dat->mappedFile);
+	if(dat->indexFile.data) //Entries and lookup tables point into the index cache
+		UnmapFile(&dat->indexFile);
+	else
+	{
+		for(int i = 0; i < dat->entryListCount; i++)
+			delete[]dat->entryLists[i].entries;
+		delete[]dat->typeIndex.slots;
+		delete[]dat->idIndex.slots;
+	}
+	delete[]dat->entryLists;
+	delete dat;
 	return 1;
 }
 
-bool Prince_LoadEntryFromDAT(unsigned char **data, unsigned int *size, int loadEntryIdx, int loadEntryId, unsigned short *entryId)
+bool Prince_LoadEntryPointerFromDAT(princeDat_s *dat, const unsigned char **data, unsigned int *size, int loadEntryIdx, int loadEntryId, unsigned short *entryId) //Returned data points into the mapped DAT and stays valid until the DAT is closed
 {
 	if(entryId)
 		*entryId = 0;
@@ -225,132 +574,180 @@ bool Prince_LoadEntryFromDAT(unsigned char **data, unsigned int *size, int loadE
 		StatusUpdate("Warning: Both loadEntryIdx and loadEntryId can't be -1 during F_Prince_LoadEntryFromDAT()");
 		return 0;
 	}
-	if(datContext.file == 0 || datContext.entryLists == 0)
+	if(dat == 0 || dat->entryLists == 0)
 	{
-		StatusUpdate("Warning: Failed to load DAT entry because of missing pointers in datContext");
+		StatusUpdate("Warning: Failed to load DAT entry because the DAT handle is invalid");
 		return 0;
 	}
 
 	//Find entry index if we're finding entry based on id rather than index
 	if(loadEntryIdx == -1)
 	{
-		for(int j = 0; j < datContext.entryLists[0].entryCount; j++)
-		{
-			if(datContext.entryLists[0].entries[j].id == loadEntryId)
-			{
-				loadEntryIdx = j;
-				break;
-			}
-		}
-		if(loadEntryIdx == -1)
+		const entryIndexSlot_s *slot = FindInEntryIndex(&dat->idIndex, loadEntryId);
+		if(slot == 0)
 		{
 			StatusUpdate("Warning: Could not find entry with id %u in DAT during F_Prince_LoadEntryFromDAT()", loadEntryId);
 			return 0;
 		}
+		loadEntryIdx = slot->entryIdx;
 	}
 
-	if(loadEntryIdx >= (int) datContext.totalFileCount)
+	if(loadEntryIdx >= (int) dat->totalFileCount)
 	{
-		StatusUpdate("Warning: Tried to load entry %u from DAT file but there are only %u entries.", loadEntryIdx, datContext.totalFileCount);
+		StatusUpdate("Warning: Tried to load entry %u from DAT file but there are only %u entries.", loadEntryIdx, dat->totalFileCount);
 		return 0;
 	}
-	*size = datContext.entryLists[0].entries[loadEntryIdx].size;
-	*data = new unsigned char [*size];
-	unsigned char checksumByte;
-	fseek(datContext.file, datContext.entryLists[0].entries[loadEntryIdx].offset, SEEK_SET);
-	fread(&checksumByte, 1, 1, datContext.file);
-	fread(*data, *size, 1, datContext.file);
+	*size = dat->entryLists[0].entries[loadEntryIdx].size;
+	*data = dat->mappedFile.data + dat->entryLists[0].entries[loadEntryIdx].offset + 1; //Skip checksum byte
 	if(entryId)
-		*entryId = datContext.entryLists[0].entries[loadEntryIdx].id;
+		*entryId = dat->entryLists[0].entries[loadEntryIdx].id;
 	return 1;
 }
 
-bool Prince_LoadEntryFromDATv2(unsigned char **data, unsigned int *size, int type, int loadEntryIdx, int loadEntryId, unsigned short *entryId, unsigned char *flags)
+bool Prince_LoadEntryFromDAT(princeDat_s *dat, unsigned char **data, unsigned int *size, int loadEntryIdx, int loadEntryId, unsigned short *entryId)
+{
+	const unsigned char *mappedData = 0;
+	if(!Prince_LoadEntryPointerFromDAT(dat, &mappedData, size, loadEntryIdx, loadEntryId, entryId))
+		return 0;
+	*data = new unsigned char [*size];
+	memcpy(*data, mappedData, *size);
+	return 1;
+}
+
+bool Prince_CopyEntryFromDAT(princeDat_s *dat, unsigned char *buffer, unsigned int bufferSize, unsigned int *size, int loadEntryIdx, int loadEntryId, unsigned short *entryId) //Copies entry into a caller-provided buffer. If the buffer is too small, this fails but size is still set to the size of the entry.
+{
+	const unsigned char *mappedData = 0;
+	if(!Prince_LoadEntryPointerFromDAT(dat, &mappedData, size, loadEntryIdx, loadEntryId, entryId))
+		return 0;
+	if(*size > bufferSize)
+		return 0;
+	memcpy(buffer, mappedData, *size);
+	return 1;
+}
+
+bool Prince_LoadEntryPointerFromDATv2(princeDat_s *dat, const unsigned char **data, unsigned int *size, int type, int loadEntryIdx, int loadEntryId, unsigned short *entryId, unsigned char *flags, int *entryType, bool *checksumValid) //Returned data points into the mapped DAT and stays valid until the DAT is closed. Type can be -1 when loading based on id, in which case we return the first entry with that id regardless of type.
 {
 	if(entryId)
 		*entryId = 0;
 	if(flags)
 		memcpy(flags, "\0\0\0", 3);
+	if(entryType)
+		*entryType = -1;
 	if(loadEntryIdx == -1 && loadEntryId == -1)
 	{
 		StatusUpdate("Warning: Both loadEntryIdx and loadEntryId can't be -1 during F_Prince_LoadEntryFromDATv2()");
 		return 0;
 	}
-	if(datContext.file == 0 || datContext.entryLists == 0)
+	if(dat == 0 || dat->entryLists == 0)
 	{
-		StatusUpdate("Warning: Failed to load DAT entry because of missing pointers in datContext");
+		StatusUpdate("Warning: Failed to load DAT entry because the DAT handle is invalid");
 		return 0;
 	}
 
-	//Find type
-	for(int i = 0; i < datContext.entryListCount; i++)
+	//Find entry list and entry index
+	int listIdx = -1;
+	if(type == -1)
 	{
-		if(datContext.entryLists[i].type == type)
+		if(loadEntryIdx != -1)
 		{
-			//Find entry index if we're finding entry based on id rather than index
-			if(loadEntryIdx == -1)
-			{
-				for(int j = 0; j < datContext.entryLists[i].entryCount; j++)
-				{
-					if(datContext.entryLists[i].entries[j].id == loadEntryId)
-					{
-						loadEntryIdx = j;
-						break;
-					}
-				}
-				if(loadEntryIdx == -1)
-				{
-					StatusUpdate("Warning: Could not find entry with id %u in DAT during F_Prince_LoadEntryFromDATv2()", loadEntryId);
-					return 0;
-				}
-			}
+			StatusUpdate("Warning: Type has to be defined when loading based on index during F_Prince_LoadEntryFromDATv2()");
+			return 0;
+		}
+		const entryIndexSlot_s *slot = FindInEntryIndex(&dat->idIndex, loadEntryId);
+		if(slot == 0)
+		{
+			StatusUpdate("Warning: Could not find entry with id %u in DAT during F_Prince_LoadEntryFromDATv2()", loadEntryId);
+			return 0;
+		}
+		listIdx = slot->listIdx;
+		loadEntryIdx = slot->entryIdx;
+	}
+	else
+	{
+		if(type >= 0 && type < DAT_TYPECOUNT)
+			listIdx = dat->typeListIdx[type];
+		if(listIdx == -1)
+		{
+			StatusUpdate("Warning: Failed to find type %u during F_Prince_LoadEntryFromDATv2()", type);
+			return 0;
+		}
 
-			if(loadEntryIdx >= (int) datContext.entryLists[i].entryCount)
+		//Find entry index if we're finding entry based on id rather than index
+		if(loadEntryIdx == -1)
+		{
+			const entryIndexSlot_s *slot = FindInEntryIndex(&dat->typeIndex, (type << 16) | (loadEntryId & 0xFFFF));
+			if(loadEntryId > 0xFFFF || slot == 0)
 			{
-				StatusUpdate("Warning: Tried to load entry %u from DAT file but there are only %u entries of type %u.", loadEntryIdx, datContext.totalFileCount, type);
+				StatusUpdate("Warning: Could not find entry with id %u in DAT during F_Prince_LoadEntryFromDATv2()", loadEntryId);
 				return 0;
 			}
-			*size = datContext.entryLists[i].entries[loadEntryIdx].size;
-			*data = new unsigned char [*size];
+			loadEntryIdx = slot->entryIdx;
+		}
 
-			unsigned char checksumByte;
-			fseek(datContext.file, datContext.entryLists[i].entries[loadEntryIdx].offset, SEEK_SET);
-			fread(&checksumByte, 1, 1, datContext.file);
-			fread(*data, *size, 1, datContext.file);
+		if(loadEntryIdx >= (int) dat->entryLists[listIdx].entryCount)
+		{
+			StatusUpdate("Warning: Tried to load entry %u from DAT file but there are only %u entries of type %u.", loadEntryIdx, dat->entryLists[listIdx].entryCount, type);
+			return 0;
+		}
+	}
 
-			//Checksum verification
-			unsigned char entrySumAlt = checksumByte;
-			for(unsigned int k = 0; k < datContext.entryLists[i].entries[loadEntryIdx].size; k++)
-			{
-				entrySumAlt += (*data)[k];
-			}
-			//entrySumAlt should be 0xFF at this point
+	const datFooterEntryV2_s *entry = &dat->entryLists[listIdx].entries[loadEntryIdx];
+	*size = entry->size;
+	*data = dat->mappedFile.data + entry->offset + 1; //Skip checksum byte
 
-			if(entryId)
-				*entryId = datContext.entryLists[i].entries[loadEntryIdx].id;
-			if(flags)
-				memcpy(flags, datContext.entryLists[i].entries[loadEntryIdx].flags, 3);
-			return 1;
-		}
+	//Checksum verification is only done when asked for, and the index cache already knows the result
+	if(checksumValid)
+	{
+		if(dat->entryLists[listIdx].checksumStatus)
+			*checksumValid = dat->entryLists[listIdx].checksumStatus[loadEntryIdx] != 0;
+		else
+			*checksumValid = EntryChecksumIsValid(dat, entry);
 	}
-	StatusUpdate("Warning: Failed to find type %u during F_Prince_LoadEntryFromDATv2()");
-	return 0;
+
+	if(entryId)
+		*entryId = entry->id;
+	if(flags)
+		memcpy(flags, entry->flags, 3);
+	if(entryType)
+		*entryType = dat->entryLists[listIdx].type;
+	return 1;
+}
+
+bool Prince_LoadEntryFromDATv2(princeDat_s *dat, unsigned char **data, unsigned int *size, int type, int loadEntryIdx, int loadEntryId, unsigned short *entryId, unsigned char *flags, int *entryType, bool *checksumValid)
+{
+	const unsigned char *mappedData = 0;
+	if(!Prince_LoadEntryPointerFromDATv2(dat, &mappedData, size, type, loadEntryIdx, loadEntryId, entryId, flags, entryType, checksumValid))
+		return 0;
+	*data = new unsigned char [*size];
+	memcpy(*data, mappedData, *size);
+	return 1;
+}
+
+bool Prince_CopyEntryFromDATv2(princeDat_s *dat, unsigned char *buffer, unsigned int bufferSize, unsigned int *size, int type, int loadEntryIdx, int loadEntryId, unsigned short *entryId, unsigned char *flags, int *entryType, bool *checksumValid) //Copies entry into a caller-provided buffer. If the buffer is too small, this fails but size is still set to the size of the entry.
+{
+	const unsigned char *mappedData = 0;
+	if(!Prince_LoadEntryPointerFromDATv2(dat, &mappedData, size, type, loadEntryIdx, loadEntryId, entryId, flags, entryType, checksumValid))
+		return 0;
+	if(*size > bufferSize)
+		return 0;
+	memcpy(buffer, mappedData, *size);
+	return 1;
 }
 
-int Prince_ReturnFileTypeCountFromDAT(int type) //This operation only works with a POP2 DAT file
+int Prince_ReturnFileTypeCountFromDAT(princeDat_s *dat, int type) //This operation only works with a POP2 DAT file
 {
-	if(datContext.file == 0 || datContext.entryLists == 0)
+	if(dat == 0 || dat->entryLists == 0)
 	{
-		StatusUpdate("Warning: Failed to load DAT entry because of missing pointers in datContext");
+		StatusUpdate("Warning: Failed to load DAT entry because the DAT handle is invalid");
 		return 0;
 	}
 
 	//Count entries matching count and return it
 	int count = 0;
-	for(int i = 0; i < datContext.entryListCount; i++)
+	for(int i = 0; i < dat->entryListCount; i++)
 	{
-		if(datContext.entryLists[i].type == type)
-			count += datContext.entryLists[i].entryCount;
+		if(dat->entryLists[i].type == type)
+			count += dat->entryLists[i].entryCount;
 	}
 	return count;
 }
\ No newline at end of file
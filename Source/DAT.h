@@ -17,9 +17,16 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
 
-bool Prince_OpenDAT(const char *path, int *entryCount = 0);
-bool Prince_OpenDATv2(const char *path, int *entryCount = 0);
-bool Prince_CloseDAT();
-bool Prince_LoadEntryFromDAT(unsigned char **data, unsigned int *size, int loadEntryIdx = -1, int loadEntryId = -1, unsigned short *entryId = 0);
-bool Prince_LoadEntryFromDATv2(unsigned char **data, unsigned int *size, int type, int loadEntryIdx = -1, int loadEntryId = -1, unsigned short *entryId = 0, unsigned char *flags = 0);
-int Prince_ReturnFileTypeCountFromDAT(int type);
\ No newline at end of file
+struct princeDat_s; //Handle for an open DAT file. Each handle is independent, so several DATs can be open at once and handles can be used from different threads (as long as one handle isn't used by two threads at the same time)
+
+princeDat_s *Prince_OpenDAT(const char *path, int *entryCount = 0);
+princeDat_s *Prince_OpenDATv2(const char *path, int *entryCount = 0);
+void Prince_UseDATIndexCache(bool enable); //Prince_OpenDATv2() reads DATs through a "<DAT>.idx" index cache written next to them, so reopening a DAT doesn't have to parse it again. Off by default
+bool Prince_CloseDAT(princeDat_s *dat);
+bool Prince_LoadEntryPointerFromDAT(princeDat_s *dat, const unsigned char **data, unsigned int *size, int loadEntryIdx = -1, int loadEntryId = -1, unsigned short *entryId = 0);
+bool Prince_LoadEntryFromDAT(princeDat_s *dat, unsigned char **data, unsigned int *size, int loadEntryIdx = -1, int loadEntryId = -1, unsigned short *entryId = 0);
+bool Prince_CopyEntryFromDAT(princeDat_s *dat, unsigned char *buffer, unsigned int bufferSize, unsigned int *size, int loadEntryIdx = -1, int loadEntryId = -1, unsigned short *entryId = 0);
+bool Prince_LoadEntryPointerFromDATv2(princeDat_s *dat, const unsigned char **data, unsigned int *size, int type, int loadEntryIdx = -1, int loadEntryId = -1, unsigned short *entryId = 0, unsigned char *flags = 0, int *entryType = 0, bool *checksumValid = 0);
+bool Prince_LoadEntryFromDATv2(princeDat_s *dat, unsigned char **data, unsigned int *size, int type, int loadEntryIdx = -1, int loadEntryId = -1, unsigned short *entryId = 0, unsigned char *flags = 0, int *entryType = 0, bool *checksumValid = 0);
+bool Prince_CopyEntryFromDATv2(princeDat_s *dat, unsigned char *buffer, unsigned int bufferSize, unsigned int *size, int type, int loadEntryIdx = -1, int loadEntryId = -1, unsigned short *entryId = 0, unsigned char *flags = 0, int *entryType = 0, bool *checksumValid = 0);
+int Prince_ReturnFileTypeCountFromDAT(princeDat_s *dat, int type);
\ No newline at end of file
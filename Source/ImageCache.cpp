@@ -0,0 +1,170 @@
+/*
+Copyright (C) 2023 FluffyQuack
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <string>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include "Misc.h"
+#include "Vars.h"
+#include "DAT-Formats.h"
+#include "ImageCache.h"
+
+struct princeCachedImage_s
+{
+	princeIndexedImage_s image;
+	std::pair<std::string, int> key;
+	std::mutex decodeMutex; //Held while the image is decoded so other threads wait for it instead of decoding it as well
+	bool decoded;
+	bool valid; //False if decoding failed
+	int refCount; //Protected by the cache mutex, like everything below
+	bool unused; //In the list of images nobody is using
+	princeCachedImage_s *newer;
+	princeCachedImage_s *older;
+};
+
+struct princeImageCache_s
+{
+	std::mutex mutex;
+	std::map<std::pair<std::string, int>, princeCachedImage_s*> images;
+	princeCachedImage_s *newestUnused;
+	princeCachedImage_s *oldestUnused;
+	size_t unusedSize; //Bytes of decoded images in the unused list
+	size_t maxUnusedSize;
+};
+
+static void UnlinkUnused(princeImageCache_s *cache, princeCachedImage_s *entry)
+{
+	if(entry->newer)
+		entry->newer->older = entry->older;
+	else
+		cache->newestUnused = entry->older;
+	if(entry->older)
+		entry->older->newer = entry->newer;
+	else
+		cache->oldestUnused = entry->newer;
+	entry->newer = 0;
+	entry->older = 0;
+	entry->unused = 0;
+	cache->unusedSize -= entry->image.width * entry->image.height;
+}
+
+static void FreeCachedImage(princeImageCache_s *cache, princeCachedImage_s *entry)
+{
+	cache->images.erase(entry->key);
+	Prince_FreeIndexedImage(&entry->image);
+	delete entry;
+}
+
+princeImageCache_s *Prince_CreateImageCache(unsigned int maxUnusedSize)
+{
+	princeImageCache_s *cache = new princeImageCache_s;
+	cache->newestUnused = 0;
+	cache->oldestUnused = 0;
+	cache->unusedSize = 0;
+	cache->maxUnusedSize = maxUnusedSize;
+	return cache;
+}
+
+void Prince_FreeImageCache(princeImageCache_s *cache)
+{
+	while(!cache->images.empty())
+		FreeCachedImage(cache, cache->images.begin()->second);
+	delete cache;
+}
+
+princeCachedImage_s *Prince_AcquireCachedImage(princeImageCache_s *cache, const char *archive, int id, const unsigned char *srcImgData, unsigned int srcImgDataSize, princeImageScratch_s *scratch)
+{
+	//Find or add the entry, and make sure it can't be pushed out while we use it
+	std::pair<std::string, int> key(archive, id);
+	cache->mutex.lock();
+	princeCachedImage_s *entry;
+	std::map<std::pair<std::string, int>, princeCachedImage_s*>::iterator it = cache->images.find(key);
+	if(it != cache->images.end())
+	{
+		entry = it->second;
+		if(entry->unused)
+			UnlinkUnused(cache, entry);
+	}
+	else
+	{
+		entry = new princeCachedImage_s;
+		memset(&entry->image, 0, sizeof(princeIndexedImage_s));
+		entry->key = key;
+		entry->decoded = 0;
+		entry->valid = 0;
+		entry->refCount = 0;
+		entry->unused = 0;
+		entry->newer = 0;
+		entry->older = 0;
+		cache->images[key] = entry;
+	}
+	entry->refCount++;
+	cache->mutex.unlock();
+
+	entry->decodeMutex.lock();
+	if(!entry->decoded)
+	{
+		entry->valid = Prince_DecodeIndexedImage(srcImgData, srcImgDataSize, &entry->image, scratch);
+		entry->decoded = 1;
+	}
+	entry->decodeMutex.unlock();
+
+	if(!entry->valid)
+	{
+		Prince_ReleaseCachedImage(cache, entry);
+		return 0;
+	}
+	return entry;
+}
+
+const princeIndexedImage_s *Prince_CachedImageData(const princeCachedImage_s *entry)
+{
+	return &entry->image;
+}
+
+void Prince_ReleaseCachedImage(princeImageCache_s *cache, princeCachedImage_s *entry)
+{
+	cache->mutex.lock();
+	entry->refCount--;
+	if(entry->refCount == 0)
+	{
+		if(!entry->valid) //Failed images aren't kept, so the next attempt reports the same warnings
+			FreeCachedImage(cache, entry);
+		else
+		{
+			entry->unused = 1;
+			entry->older = cache->newestUnused;
+			if(cache->newestUnused)
+				cache->newestUnused->newer = entry;
+			else
+				cache->oldestUnused = entry;
+			cache->newestUnused = entry;
+			cache->unusedSize += entry->image.width * entry->image.height;
+
+			//Push out images that have gone unused the longest
+			while(cache->unusedSize > cache->maxUnusedSize)
+			{
+				princeCachedImage_s *oldest = cache->oldestUnused;
+				UnlinkUnused(cache, oldest);
+				FreeCachedImage(cache, oldest);
+			}
+		}
+	}
+	cache->mutex.unlock();
+}
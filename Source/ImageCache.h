@@ -0,0 +1,31 @@
+/*
+Copyright (C) 2023 FluffyQuack
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#define IMAGECACHE_DEFAULTSIZE (64 * 1024 * 1024) //Decoded images nobody is using are kept until they take up more than this many bytes
+
+struct princeImageCache_s; //Decoded images keyed by (archive, entry id). Rendering an entry under another palette only needs a lookup table pass instead of decompressing it again. Safe to use from several threads at the same time
+struct princeCachedImage_s; //Handle for an image acquired from the cache
+struct princeIndexedImage_s;
+struct princeImageScratch_s;
+
+princeImageCache_s *Prince_CreateImageCache(unsigned int maxUnusedSize = IMAGECACHE_DEFAULTSIZE);
+void Prince_FreeImageCache(princeImageCache_s *cache); //Every image has to be released first
+princeCachedImage_s *Prince_AcquireCachedImage(princeImageCache_s *cache, const char *archive, int id, const unsigned char *srcImgData, unsigned int srcImgDataSize, princeImageScratch_s *scratch = 0); //Decodes the image the first time an entry is asked for. If another thread is decoding it, we wait for that instead. Returns 0 if the image can't be decoded
+const princeIndexedImage_s *Prince_CachedImageData(const princeCachedImage_s *cachedImage); //Decoded image stays valid until the handle is released
+void Prince_ReleaseCachedImage(princeImageCache_s *cache, princeCachedImage_s *cachedImage); //Image stays in the cache until it's pushed out by images that were released later
\ No newline at end of file
@@ -0,0 +1,269 @@
+/*
+Copyright (C) 2023 FluffyQuack
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "Platform.h"
+#include "Misc.h"
+#include "ImageWriters.h"
+
+struct imageFormat_s
+{
+	const char *name;
+	const char *extension;
+};
+
+static const imageFormat_s imageFormats[IMAGEFORMAT_COUNT] =
+{
+	{"png", "png"},
+	{"qoi", "qoi"},
+	{"tga", "tga"},
+};
+
+static int imageFormat = IMAGEFORMAT_PNG;
+
+void SetImageFormat(int format)
+{
+	imageFormat = format;
+}
+
+int GetImageFormat()
+{
+	return imageFormat;
+}
+
+int ImageFormatFromName(const char *name)
+{
+	for(int i = 0; i < IMAGEFORMAT_COUNT; i++)
+	{
+		if(_stricmp(name, imageFormats[i].name) == 0)
+			return i;
+	}
+	return -1;
+}
+
+const char *ImageFormatExtension()
+{
+	return imageFormats[imageFormat].extension;
+}
+
+//QOI chunk tags. See https://qoiformat.org/qoi-specification.pdf
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xc0
+#define QOI_OP_RGB 0xfe
+#define QOI_OP_RGBA 0xff
+#define QOI_HEADERSIZE 14
+#define QOI_ENDMARKERSIZE 8
+
+static void WriteBigEndian32(unsigned char *dest, unsigned int value)
+{
+	dest[0] = (unsigned char) (value >> 24);
+	dest[1] = (unsigned char) (value >> 16);
+	dest[2] = (unsigned char) (value >> 8);
+	dest[3] = (unsigned char) value;
+}
+
+bool EncodeImageAsQOI(const unsigned char *imgData, unsigned int width, unsigned int height, unsigned char channels, unsigned char **fileData, size_t *fileDataSize) //This takes raw RGB or RGBA image data as input. fileData has to be freed with free()
+{
+	*fileData = 0;
+	*fileDataSize = 0;
+	if(channels != 3 && channels != 4)
+	{
+		StatusUpdate("Warning: Can't encode image with %u channels as QOI", channels);
+		return 0;
+	}
+
+	//Worst case is every pixel stored as a full QOI_OP_RGBA (or QOI_OP_RGB) chunk
+	size_t pixelCount = (size_t) width * height;
+	unsigned char *out = (unsigned char *) malloc(QOI_HEADERSIZE + pixelCount * (channels + 1) + QOI_ENDMARKERSIZE);
+	if(!out)
+	{
+		StatusUpdate("Warning: Failed to allocate memory for %ux%u QOI image", width, height);
+		return 0;
+	}
+
+	memcpy(out, "qoif", 4);
+	WriteBigEndian32(&out[4], width);
+	WriteBigEndian32(&out[8], height);
+	out[12] = channels;
+	out[13] = 0; //sRGB with linear alpha
+	size_t pos = QOI_HEADERSIZE;
+
+	unsigned char seen[64][4]; //Recently seen pixels, indexed by a hash of their colour
+	memset(seen, 0, sizeof(seen));
+	unsigned char prev[4] = {0, 0, 0, 255};
+	unsigned char px[4] = {0, 0, 0, 255};
+	unsigned int run = 0;
+	const unsigned char *in = imgData;
+	for(size_t i = 0; i < pixelCount; i++, in += channels)
+	{
+		px[0] = in[0];
+		px[1] = in[1];
+		px[2] = in[2];
+		if(channels == 4)
+			px[3] = in[3];
+
+		if(memcmp(px, prev, 4) == 0)
+		{
+			run++;
+			if(run == 62 || i == pixelCount - 1)
+			{
+				out[pos++] = QOI_OP_RUN | (run - 1);
+				run = 0;
+			}
+			continue;
+		}
+		if(run > 0)
+		{
+			out[pos++] = QOI_OP_RUN | (run - 1);
+			run = 0;
+		}
+
+		unsigned int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+		if(memcmp(seen[hash], px, 4) == 0)
+			out[pos++] = QOI_OP_INDEX | hash;
+		else
+		{
+			memcpy(seen[hash], px, 4);
+			if(px[3] == prev[3])
+			{
+				signed char dr = (signed char) (px[0] - prev[0]);
+				signed char dg = (signed char) (px[1] - prev[1]);
+				signed char db = (signed char) (px[2] - prev[2]);
+				signed char dgr = dr - dg;
+				signed char dgb = db - dg;
+				if(dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+					out[pos++] = QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2);
+				else if(dg >= -32 && dg <= 31 && dgr >= -8 && dgr <= 7 && dgb >= -8 && dgb <= 7)
+				{
+					out[pos++] = QOI_OP_LUMA | (dg + 32);
+					out[pos++] = (dgr + 8) << 4 | (dgb + 8);
+				}
+				else
+				{
+					out[pos++] = QOI_OP_RGB;
+					out[pos++] = px[0];
+					out[pos++] = px[1];
+					out[pos++] = px[2];
+				}
+			}
+			else
+			{
+				out[pos++] = QOI_OP_RGBA;
+				memcpy(&out[pos], px, 4);
+				pos += 4;
+			}
+		}
+		memcpy(prev, px, 4);
+	}
+
+	memset(&out[pos], 0, QOI_ENDMARKERSIZE - 1);
+	out[pos + QOI_ENDMARKERSIZE - 1] = 1;
+	pos += QOI_ENDMARKERSIZE;
+
+	*fileData = out;
+	*fileDataSize = pos;
+	return 1;
+}
+
+#define TGA_HEADERSIZE 18
+
+bool EncodeImageAsTGA(const unsigned char *imgData, unsigned int width, unsigned int height, unsigned char channels, unsigned char **fileData, size_t *fileDataSize) //This takes raw RGB or RGBA image data as input and writes it as an uncompressed true colour TGA. fileData has to be freed with free()
+{
+	*fileData = 0;
+	*fileDataSize = 0;
+	if(channels != 3 && channels != 4)
+	{
+		StatusUpdate("Warning: Can't encode image with %u channels as TGA", channels);
+		return 0;
+	}
+	if(width > 0xFFFF || height > 0xFFFF)
+	{
+		StatusUpdate("Warning: Image size %ux%u is too big for TGA", width, height);
+		return 0;
+	}
+
+	size_t pixelCount = (size_t) width * height;
+	size_t size = TGA_HEADERSIZE + pixelCount * channels;
+	unsigned char *out = (unsigned char *) malloc(size);
+	if(!out)
+	{
+		StatusUpdate("Warning: Failed to allocate memory for %ux%u TGA image", width, height);
+		return 0;
+	}
+
+	memset(out, 0, TGA_HEADERSIZE);
+	out[2] = 2; //Uncompressed true colour
+	out[12] = (unsigned char) width;
+	out[13] = (unsigned char) (width >> 8);
+	out[14] = (unsigned char) height;
+	out[15] = (unsigned char) (height >> 8);
+	out[16] = channels * 8;
+	out[17] = 0x20 | (channels == 4 ? 8 : 0); //Rows are stored top to bottom, plus the number of alpha bits
+
+	//TGA stores colours as BGR(A)
+	const unsigned char *in = imgData;
+	unsigned char *dest = &out[TGA_HEADERSIZE];
+	if(channels == 4)
+	{
+		for(size_t i = 0; i < pixelCount; i++, in += 4, dest += 4)
+		{
+			dest[0] = in[2];
+			dest[1] = in[1];
+			dest[2] = in[0];
+			dest[3] = in[3];
+		}
+	}
+	else
+	{
+		for(size_t i = 0; i < pixelCount; i++, in += 3, dest += 3)
+		{
+			dest[0] = in[2];
+			dest[1] = in[1];
+			dest[2] = in[0];
+		}
+	}
+
+	*fileData = out;
+	*fileDataSize = size;
+	return 1;
+}
+
+bool EncodeImage(const unsigned char *imgData, unsigned int width, unsigned int height, unsigned char channels, unsigned char **fileData, size_t *fileDataSize) //This takes raw RGB or RGBA image data as input. fileData has to be freed with free()
+{
+	if(imageFormat == IMAGEFORMAT_QOI)
+		return EncodeImageAsQOI(imgData, width, height, channels, fileData, fileDataSize);
+	if(imageFormat == IMAGEFORMAT_TGA)
+		return EncodeImageAsTGA(imgData, width, height, channels, fileData, fileDataSize);
+	return EncodeImageAsPNG(imgData, width, height, channels, fileData, fileDataSize);
+}
+
+bool SaveImage(char *path, unsigned char *imgData, unsigned int width, unsigned int height, unsigned char channels) //This takes raw RGB or RGBA image data as input
+{
+	if(imageFormat == IMAGEFORMAT_PNG)
+		return SaveImageAsPNG(path, imgData, width, height, channels);
+
+	unsigned char *fileData = 0;
+	size_t fileDataSize;
+	if(!EncodeImage(imgData, width, height, channels, &fileData, &fileDataSize))
+		return 0;
+	bool success = WriteDataToFile(path, fileData, fileDataSize);
+	free(fileData);
+	return success;
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+/*
+Copyright (C) 2023 FluffyQuack
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+//Image file formats we can write
+enum
+{
+	IMAGEFORMAT_PNG,
+	IMAGEFORMAT_QOI, //"Quite OK Image" format. Lossless and much faster to encode than PNG
+	IMAGEFORMAT_TGA, //Uncompressed Targa
+
+	IMAGEFORMAT_COUNT
+};
+
+void SetImageFormat(int format); //Used by every EncodeImage() and SaveImage() call after this. Default is IMAGEFORMAT_PNG
+int GetImageFormat();
+int ImageFormatFromName(const char *name); //Returns -1 if there's no format with that name
+const char *ImageFormatExtension(); //File extension for the current format (without the dot)
+bool EncodeImageAsQOI(const unsigned char *imgData, unsigned int width, unsigned int height, unsigned char channels, unsigned char **fileData, size_t *fileDataSize);
+bool EncodeImageAsTGA(const unsigned char *imgData, unsigned int width, unsigned int height, unsigned char channels, unsigned char **fileData, size_t *fileDataSize);
+bool EncodeImage(const unsigned char *imgData, unsigned int width, unsigned int height, unsigned char channels, unsigned char **fileData, size_t *fileDataSize); //Encodes raw RGB or RGBA image data in the current format. fileData has to be freed with free()
+bool SaveImage(char *path, unsigned char *imgData, unsigned int width, unsigned int height, unsigned char channels); //Path should end with ImageFormatExtension()
\ No newline at end of file
@@ -0,0 +1,567 @@
+/*
+Copyright (C) 2023 FluffyQuack
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+#include "Platform.h"
+#include "Misc.h"
+#include "Vars.h"
+#include "DAT.h"
+#include "DAT-Formats.h"
+#include "ThreadPool.h"
+#include "Manifest.h"
+
+#define MAXLINELENGTH 1000
+
+/*
+Extraction manifests define which DATs -all extracts and which palette to use for which images. Format:
+- "game pop1" or "game pop2"
+- "palette <name> <dat> <entry type> <entry id> [palette format]" declares a palette source. The DAT can be any DAT, not just the one we're extracting. Entry type is bin (POP1 DAT entry), cga, svga, tga, or shape. Palette format is pal, multipal, cga, svga, tga, or shape (defaults to entry type, or pal for POP1).
+- "dat <path>" adds a DAT to extract. A DAT without any rules is extracted using the automatic palette.
+- "rule <start id> <end id> <palette name>" applies to the last DAT line. Ids can be * for no bound and palette name can be "auto". If rules overlap, the last one wins.
+Everything after # is a comment. POP1 DATs only support one palette for the whole DAT.
+*/
+
+static const char *defaultManifestPOP1 =
+	"game pop1\n"
+	"\n"
+	"dat KID.DAT\n"
+	"dat VDUNGEON.DAT\n"
+	"dat FAT.DAT\n"
+	"dat VPALACE.DAT\n"
+	"dat GUARD1.DAT\n"
+	"dat GUARD2.DAT\n"
+	"\n"
+	"palette guard PRINCE.DAT bin 10 multipal\n"
+	"dat GUARD.DAT\n"
+	"rule * * guard\n"
+	"\n"
+	"dat PRINCE.DAT\n"
+	"dat PV.DAT\n"
+	"dat SHADOW.DAT\n"
+	"dat SKEL.DAT\n"
+	"dat TITLE.DAT\n"
+	"dat VIZIER.DAT\n";
+
+static const char *defaultManifestPOP2 =
+	"game pop2\n"
+	"\n"
+	"dat BIRD.DAT #Everything uses correct palette automatically\n"
+	"\n"
+	"palette carpet CAVERNS.DAT svga 25303\n"
+	"dat CAVERNS.DAT #3501-4059 use correct palette automatically. 4225-4235 is the wooden bridge with loose steps tied by rope room (TODO: Which palette should we use? Or is this correct even though there are weird red pixels?)\n"
+	"rule 25303 25312 carpet #Magic carpet\n"
+	"\n"
+	"dat DESERT.DAT #First image looks a bit weird, but otherwise automatic palette is correct\n"
+	"dat DIGISND.DAT\n"
+	"\n"
+	"palette final FINAL.DAT tga 25000\n"
+	"dat FINAL.DAT #25001-26052 use correct palette automatically (TODO: Some of them are wrong)\n"
+	"rule 24902 25390 final #Not sure if these are correct\n"
+	"\n"
+	"dat FLAME.DAT #Everything uses correct palette automatically\n"
+	"dat GUARD.DAT #Everything uses correct palette automatically. However, I believe there are variants of this sprite depending on the stage\n"
+	"dat HEAD.DAT #Everything uses correct palette automatically with maybe the exception of the last image that looks a bit weird\n"
+	"dat IBMSND.DAT\n"
+	"dat JINNE.DAT\n"
+	"dat KID.DAT #Everything uses correct palette automatically, maybe with the exception of the magical-esque animation with id of around 24892\n"
+	"dat MIDISND.DAT\n"
+	"\n"
+	"palette nis1 NIS.DAT tga 27001\n"
+	"palette nis2 NIS.DAT tga 28001\n"
+	"palette nis3 NIS.DAT tga 29001\n"
+	"palette nis4 NIS.DAT tga 30001\n"
+	"dat NIS.DAT #3501-4189 use correct palette automatically (maybe a few are wrong, but they look right at first glance)\n"
+	"rule 27004 27045 nis1 #Some are wrong\n"
+	"rule 28002 28017 nis2 #Some are wrong\n"
+	"rule 29002 29023 nis3 #Some are wrong\n"
+	"rule 30002 30044 nis4 #Some are wrong\n"
+	"\n"
+	"dat NIS3VC.DAT\n"
+	"dat NISDIGI.DAT\n"
+	"dat NISIBM.DAT\n"
+	"dat NISMIDI.DAT\n"
+	"\n"
+	"palette sword PRINCE.DAT shape 1000\n"
+	"palette potions PRINCE.DAT shape 3000\n"
+	"palette copyprotection PRINCE.DAT shape 8000\n"
+	"palette horse PRINCE.DAT svga 10\n"
+	"dat PRINCE.DAT\n"
+	"rule 1001 1246 sword\n"
+	"rule 3001 3035 potions\n"
+	"rule 8001 8013 copyprotection\n"
+	"rule 25456 25458 horse #Horse statue (wrong palette)\n"
+	"\n"
+	"palette rooftops ROOFTOPS.DAT svga 3500\n"
+	"dat ROOFTOPS.DAT #3501-4122 use correct palette automatically (the first one looks weird but I think it's also unused)\n"
+	"rule 4123 4352 rooftops #These are still wrong. Maybe relying on a palette from another file?\n"
+	"\n"
+	"dat RUINS.DAT #3501-4267 use correct palette automatically. I think 4600-4602 are the starting screens for Ruins. I think palette is from another file, though\n"
+	"dat SEQUENCE.DAT\n"
+	"dat \\SEQUENCE.DAT\n"
+	"dat SKELETON.DAT #Everything uses correct palette automatically\n"
+	"\n"
+	"palette temple TEMPLE.DAT svga 4075\n"
+	"dat TEMPLE.DAT\n"
+	"rule 4078 4105 temple\n"
+	"\n"
+	"palette transplayer TRANS.DAT shape 25000\n"
+	"palette translady TRANS.DAT tga 4208 shape\n"
+	"palette transpotion TRANS.DAT shape 25000 svga\n"
+	"palette transcutscene TRANS.DAT tga 25001 svga\n"
+	"dat TRANS.DAT\n"
+	"rule 4208 4209 translady #Background for cutscene with \"come to me\" lady\n"
+	"rule 4210 4213 translady #\"Come to me\" lady sprite\n"
+	"rule 25235 25283 transplayer #Player sprite frames\n"
+	"rule 25284 25298 transplayer #More player sprite frames. Used for cutscenes?\n"
+	"rule 25299 25302 transpotion #Potion\n"
+	"rule 25312 25313 transcutscene #Game logos\n"
+	"rule 25316 25400 transcutscene #Potion\n"
+	"rule 25401 25455 transcutscene #Player riding horse in cutscene\n";
+
+static int ManifestTypeFromName(const char *name)
+{
+	if(_stricmp(name, "bin") == 0) return POP1_DATFORMAT_BIN;
+	else if(_stricmp(name, "pal") == 0) return POP1_DATFORMAT_PAL;
+	else if(_stricmp(name, "multipal") == 0) return POP1_DATFORMAT_MULTIPAL;
+	else if(_stricmp(name, "cga") == 0) return POP2_DATFORMAT_CGA_PALETTE;
+	else if(_stricmp(name, "svga") == 0) return POP2_DATFORMAT_SVGA_PALETTE;
+	else if(_stricmp(name, "tga") == 0) return POP2_DATFORMAT_TGA_PALETTE;
+	else if(_stricmp(name, "shape") == 0) return POP2_DATFORMAT_SHAPE_PALETTE;
+	return -1;
+}
+
+static bool ReadManifestId(char *line, int target, int *id) //Reads an id which can be * for "no bound"
+{
+	if(!ReadValue(line, target, RV_STRING))
+		return 0;
+	if(strcmp(r_str, "*") == 0)
+	{
+		*id = -1;
+		return 1;
+	}
+	if(!IsNumber(r_str))
+		return 0;
+	*id = atoi(r_str);
+	return 1;
+}
+
+//Copies one line of text. Returns 1 if it's at the end of the data
+static bool CopyLineFromManifest(char *dest, const char *src, unsigned int *pos, unsigned int maxSize, unsigned int maxLineLength)
+{
+	unsigned int i = 0;
+	while(*pos < maxSize && src[*pos] != '\n' && src[*pos] != '\r')
+	{
+		if(i + 1 < maxLineLength)
+			dest[i++] = src[*pos];
+		(*pos)++;
+	}
+	dest[i] = 0;
+	while(*pos < maxSize && (src[*pos] == '\n' || src[*pos] == '\r'))
+		(*pos)++;
+	return *pos >= maxSize;
+}
+
+static manifest_s *ParseExtractionManifest(const char *text, unsigned int textSize, const char *name)
+{
+	manifest_s *manifest = new manifest_s;
+	memset(manifest, 0, sizeof(manifest_s));
+
+	unsigned int pos = 0;
+	int lineNum = 0;
+	bool finalLine = textSize == 0;
+	char line[MAXLINELENGTH];
+	while(!finalLine) //Read manifest line-by-line
+	{
+		finalLine = CopyLineFromManifest(line, text, &pos, textSize, MAXLINELENGTH);
+		lineNum++;
+		ReplaceSymbolWithNullInString(line, '#'); //Replace '#' with null as that means comment
+		RemoveSpacesAtStart(line);
+		if(line[0] == 0 || !ReadValue(line, 1, RV_STRING))
+			continue;
+
+		bool valid = 1;
+		if(_stricmp(r_str, "game") == 0)
+		{
+			valid = ReadValue(line, 2, RV_STRING) && (_stricmp(r_str, "pop1") == 0 || _stricmp(r_str, "pop2") == 0);
+			if(valid)
+			{
+				manifest->pop1 = _stricmp(r_str, "pop1") == 0;
+				manifest->gameDefined = 1;
+			}
+		}
+		else if(_stricmp(r_str, "palette") == 0)
+		{
+			if(manifest->paletteCount >= MANIFEST_MAXPALETTES)
+			{
+				StatusUpdate("Warning: Too many palettes in manifest %s (max is %i)", name, MANIFEST_MAXPALETTES);
+				break;
+			}
+			manifestPalette_s *palette = &manifest->palettes[manifest->paletteCount];
+			valid = ReadValue_String(line, 2, palette->name, MANIFEST_MAXNAME)
+				&& ReadValue_String(line, 3, palette->datPath, MAXPATH)
+				&& ReadValue(line, 4, RV_STRING);
+			if(valid)
+			{
+				palette->entryType = ManifestTypeFromName(r_str);
+				valid = palette->entryType == POP1_DATFORMAT_BIN || (palette->entryType >= POP2_DATFORMAT_CGA_PALETTE && palette->entryType <= POP2_DATFORMAT_SHAPE_PALETTE);
+			}
+			if(valid)
+				valid = ReadValue_Int(line, 5, &palette->entryId);
+			if(valid)
+			{
+				if(ReadValue(line, 6, RV_STRING))
+					palette->palType = ManifestTypeFromName(r_str);
+				else
+					palette->palType = palette->entryType == POP1_DATFORMAT_BIN ? POP1_DATFORMAT_PAL : palette->entryType;
+				valid = palette->palType > POP1_DATFORMAT_BIN;
+			}
+			if(valid)
+				manifest->paletteCount++;
+		}
+		else if(_stricmp(r_str, "dat") == 0)
+		{
+			if(manifest->datCount >= MANIFEST_MAXDATS)
+			{
+				StatusUpdate("Warning: Too many DATs in manifest %s (max is %i)", name, MANIFEST_MAXDATS);
+				break;
+			}
+			valid = ReadValue_String(line, 2, manifest->dats[manifest->datCount].path, MAXPATH);
+			if(valid)
+				manifest->datCount++;
+		}
+		else if(_stricmp(r_str, "rule") == 0)
+		{
+			manifestDAT_s *dat = manifest->datCount > 0 ? &manifest->dats[manifest->datCount - 1] : 0;
+			if(dat == 0 || dat->ruleCount >= MANIFEST_MAXRULES)
+			{
+				StatusUpdate("Warning: Rule on line %i in manifest %s doesn't belong to a DAT or there are too many rules for the DAT (max is %i)", lineNum, name, MANIFEST_MAXRULES);
+				continue;
+			}
+			manifestRule_s *rule = &dat->rules[dat->ruleCount];
+			valid = ReadManifestId(line, 2, &rule->startId) && ReadManifestId(line, 3, &rule->endId) && ReadValue(line, 4, RV_STRING);
+			if(valid)
+			{
+				rule->paletteIdx = -1;
+				if(_stricmp(r_str, "auto") != 0)
+				{
+					for(int i = 0; i < manifest->paletteCount; i++)
+					{
+						if(_stricmp(r_str, manifest->palettes[i].name) == 0)
+						{
+							rule->paletteIdx = i;
+							break;
+						}
+					}
+					if(rule->paletteIdx == -1)
+					{
+						StatusUpdate("Warning: Unknown palette %s on line %i in manifest %s", r_str, lineNum, name);
+						continue;
+					}
+				}
+				dat->ruleCount++;
+			}
+		}
+		else
+			valid = 0;
+
+		if(!valid)
+			StatusUpdate("Warning: Could not parse line %i in manifest %s", lineNum, name);
+	}
+	return manifest;
+}
+
+manifest_s *Prince_LoadExtractionManifest(const char *path)
+{
+	unsigned char *text = 0;
+	unsigned int textSize = 0;
+	if(!ReadFile(path, &text, &textSize))
+	{
+		StatusUpdate("Warning: Could not open manifest %s for reading.", path);
+		return 0;
+	}
+	manifest_s *manifest = ParseExtractionManifest((const char *) text, textSize, path);
+	delete[]text;
+	return manifest;
+}
+
+manifest_s *Prince_LoadDefaultExtractionManifest(bool pop1)
+{
+	const char *text = pop1 ? defaultManifestPOP1 : defaultManifestPOP2;
+	return ParseExtractionManifest(text, (unsigned int) strlen(text), pop1 ? "default POP1 manifest" : "default POP2 manifest");
+}
+
+bool Prince_WriteDefaultExtractionManifest(const char *path, bool pop1) //Writes out the built-in manifest so it can be used as a starting point for a custom one
+{
+	FILE *file;
+	fopen_s(&file, path, "wb");
+	if(!file)
+	{
+		StatusUpdate("Warning: Failed to open %s for writing.", path);
+		return 0;
+	}
+	const char *text = pop1 ? defaultManifestPOP1 : defaultManifestPOP2;
+	fwrite(text, strlen(text), 1, file);
+	fclose(file);
+	StatusUpdate("Wrote %s", path);
+	return 1;
+}
+
+static void GroupManifestPalettesBySource(const manifest_s *manifest, int *paletteGroup) //Palettes that live in the same DAT share a group, which is identified by the index of the first palette in it
+{
+	for(int i = 0; i < manifest->paletteCount; i++)
+	{
+		const manifestPalette_s *palette = &manifest->palettes[i];
+		paletteGroup[i] = i;
+		for(int j = 0; j < i; j++)
+		{
+			if(_stricmp(palette->datPath, manifest->palettes[j].datPath) == 0 && (palette->entryType == POP1_DATFORMAT_BIN) == (manifest->palettes[j].entryType == POP1_DATFORMAT_BIN))
+			{
+				paletteGroup[i] = paletteGroup[j];
+				break;
+			}
+		}
+	}
+}
+
+static bool ResolveManifestPaletteGroup(manifest_s *manifest, const int *paletteGroup, int group) //Opens the source DAT once and loads every palette in the group from it
+{
+	const char *datPath = manifest->palettes[group].datPath;
+	bool pop1DAT = manifest->palettes[group].entryType == POP1_DATFORMAT_BIN;
+	princeDat_s *dat = pop1DAT ? Prince_OpenDAT(datPath) : Prince_OpenDATv2(datPath);
+	bool success = 1;
+	for(int i = group; i < manifest->paletteCount; i++)
+	{
+		manifestPalette_s *palette = &manifest->palettes[i];
+		if(paletteGroup[i] != group || palette->data)
+			continue;
+
+		const unsigned char *palData = 0;
+		bool loaded = 0;
+		if(dat)
+		{
+			if(pop1DAT)
+				loaded = Prince_LoadEntryPointerFromDAT(dat, &palData, &palette->dataSize, -1, palette->entryId);
+			else
+				loaded = Prince_LoadEntryPointerFromDATv2(dat, &palData, &palette->dataSize, palette->entryType, -1, palette->entryId);
+		}
+		if(!loaded)
+		{
+			StatusUpdate("Warning: Could not load palette %s (entry %i in %s). Automatic palette will be used instead.", palette->name, palette->entryId, datPath);
+			palette->dataSize = 0;
+			success = 0;
+			continue;
+		}
+		palette->data = new unsigned char[palette->dataSize];
+		memcpy(palette->data, palData, palette->dataSize);
+	}
+	if(dat)
+		Prince_CloseDAT(dat);
+	return success;
+}
+
+bool Prince_ResolveManifestPalettes(manifest_s *manifest) //Loads every palette in the manifest once
+{
+	int paletteGroup[MANIFEST_MAXPALETTES];
+	GroupManifestPalettesBySource(manifest, paletteGroup);
+	bool success = 1;
+	for(int i = 0; i < manifest->paletteCount; i++)
+	{
+		if(paletteGroup[i] == i)
+			success &= ResolveManifestPaletteGroup(manifest, paletteGroup, i);
+	}
+	return success;
+}
+
+static bool ExtractManifestDAT(const manifest_s *manifest, int datIdx, threadPool_s *pool) //Palettes used by the DAT's rules have to be resolved first
+{
+	const manifestDAT_s *dat = &manifest->dats[datIdx];
+	if(manifest->pop1)
+	{
+		//POP1 DATs are extracted using one palette, so we use the palette of the last rule
+		const manifestPalette_s *palette = 0;
+		if(dat->ruleCount > 0)
+		{
+			const manifestRule_s *rule = &dat->rules[dat->ruleCount - 1];
+			if(rule->startId != -1 || rule->endId != -1)
+				StatusUpdate("Warning: Id ranges aren't supported for POP1 DATs, so palette rule for %s will be used for the whole DAT", dat->path);
+			if(rule->paletteIdx != -1)
+				palette = &manifest->palettes[rule->paletteIdx];
+		}
+		if(palette && palette->data)
+			return Prince_ExtractDAT(dat->path, palette->data, palette->dataSize, palette->palType, pool);
+		return Prince_ExtractDAT(dat->path, 0, 0, 0, pool);
+	}
+
+	princeExtractRule_s rules[MANIFEST_MAXRULES + 1];
+	int ruleCount = 0;
+	if(dat->ruleCount == 0 || dat->rules[0].startId != -1 || dat->rules[0].endId != -1) //Everything that isn't covered by a rule is extracted using the automatic palette
+		rules[ruleCount++] = Prince_AutoPaletteRule();
+	for(int i = 0; i < dat->ruleCount; i++)
+	{
+		const manifestRule_s *rule = &dat->rules[i];
+		if(rule->paletteIdx == -1)
+			rules[ruleCount++] = Prince_AutoPaletteRule(rule->startId, rule->endId);
+		else
+		{
+			const manifestPalette_s *palette = &manifest->palettes[rule->paletteIdx];
+			rules[ruleCount++] = Prince_ExternalPaletteRule(rule->startId, rule->endId, palette->data, palette->dataSize, palette->palType);
+		}
+	}
+	return Prince_ExtractDATv2Plan(dat->path, rules, ruleCount, pool);
+}
+
+struct manifestRun_s;
+
+struct manifestJob_s //Palette group or DAT extraction running as a thread pool task
+{
+	manifestRun_s *run;
+	int idx; //Palette group or DAT index
+	bool isPaletteGroup;
+	bool success;
+	bool finished;
+	statusLog_s log; //Output is held back until every job before this one has printed, so output is the same no matter how many threads we use
+};
+
+struct manifestRun_s
+{
+	manifest_s *manifest;
+	threadPool_s *pool;
+	const int *paletteGroup;
+	manifestJob_s *jobs;
+	int jobCount;
+	int nextJobToPrint;
+	std::mutex printMutex;
+};
+
+static void RunManifestJob(void *param)
+{
+	manifestJob_s *job = (manifestJob_s *) param;
+	manifestRun_s *run = job->run;
+	statusLog_s *prevLog = CaptureStatusUpdates(&job->log); //This thread might be capturing output for another job if it picked this job up while waiting for something
+	if(job->isPaletteGroup)
+		job->success = ResolveManifestPaletteGroup(run->manifest, run->paletteGroup, job->idx);
+	else
+		job->success = ExtractManifestDAT(run->manifest, job->idx, run->pool);
+	CaptureStatusUpdates(0);
+
+	run->printMutex.lock();
+	job->finished = 1;
+	while(run->nextJobToPrint < run->jobCount && run->jobs[run->nextJobToPrint].finished)
+		FlushStatusLog(&run->jobs[run->nextJobToPrint++].log);
+	run->printMutex.unlock();
+	CaptureStatusUpdates(prevLog);
+}
+
+static bool RunExtractionManifestOnPool(manifest_s *manifest, threadPool_s *pool)
+{
+	int paletteGroup[MANIFEST_MAXPALETTES];
+	GroupManifestPalettesBySource(manifest, paletteGroup);
+
+	manifestRun_s run;
+	run.manifest = manifest;
+	run.pool = pool;
+	run.paletteGroup = paletteGroup;
+	run.jobs = new manifestJob_s[manifest->paletteCount + manifest->datCount];
+	run.jobCount = 0;
+	run.nextJobToPrint = 0;
+	poolTask_s *paletteTasks[MANIFEST_MAXPALETTES] = {};
+	poolTask_s **datTasks = new poolTask_s*[manifest->datCount];
+
+	//Create tasks for palette groups and DATs
+	for(int i = 0; i < manifest->paletteCount + manifest->datCount; i++)
+	{
+		bool isPaletteGroup = i < manifest->paletteCount;
+		int idx = isPaletteGroup ? i : i - manifest->paletteCount;
+		if(isPaletteGroup && (paletteGroup[idx] != idx || manifest->palettes[idx].data))
+			continue;
+		manifestJob_s *job = &run.jobs[run.jobCount++];
+		memset(&job->log, 0, sizeof(statusLog_s));
+		job->run = &run;
+		job->idx = idx;
+		job->isPaletteGroup = isPaletteGroup;
+		job->success = 0;
+		job->finished = 0;
+		poolTask_s *task = ThreadPool_CreateTask(pool, RunManifestJob, job);
+		if(isPaletteGroup)
+			paletteTasks[idx] = task;
+		else
+			datTasks[idx] = task;
+	}
+
+	//A DAT can't be extracted before the palettes its rules use are loaded
+	for(int i = 0; i < manifest->datCount; i++)
+	{
+		const manifestDAT_s *dat = &manifest->dats[i];
+		for(int j = 0; j < dat->ruleCount; j++)
+		{
+			if(dat->rules[j].paletteIdx != -1 && paletteTasks[paletteGroup[dat->rules[j].paletteIdx]])
+				ThreadPool_AddDependency(datTasks[i], paletteTasks[paletteGroup[dat->rules[j].paletteIdx]]);
+		}
+	}
+
+	for(int i = 0; i < manifest->paletteCount; i++)
+	{
+		if(paletteTasks[i])
+		{
+			ThreadPool_Submit(pool, paletteTasks[i]);
+			ThreadPool_ReleaseTask(paletteTasks[i]);
+		}
+	}
+	for(int i = 0; i < manifest->datCount; i++)
+	{
+		ThreadPool_Submit(pool, datTasks[i]);
+		ThreadPool_ReleaseTask(datTasks[i]);
+	}
+	ThreadPool_Wait(pool);
+
+	bool success = 1;
+	for(int i = 0; i < run.jobCount; i++)
+	{
+		if(!run.jobs[i].isPaletteGroup)
+			success &= run.jobs[i].success;
+	}
+	delete[]datTasks;
+	delete[]run.jobs;
+	return success;
+}
+
+bool Prince_RunExtractionManifest(manifest_s *manifest, threadPool_s *pool)
+{
+	bool success = 1;
+	if(pool)
+		success = RunExtractionManifestOnPool(manifest, pool);
+	else
+	{
+		Prince_ResolveManifestPalettes(manifest);
+		for(int i = 0; i < manifest->datCount; i++)
+			success &= ExtractManifestDAT(manifest, i, 0);
+	}
+	return success;
+}
+
+void Prince_FreeExtractionManifest(manifest_s *manifest)
+{
+	for(int i = 0; i < manifest->paletteCount; i++)
+	{
+		if(manifest->palettes[i].data)
+			delete[]manifest->palettes[i].data;
+	}
+	delete manifest;
+}
\ No newline at end of file
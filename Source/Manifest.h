@@ -0,0 +1,67 @@
+/*
+Copyright (C) 2023 FluffyQuack
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+struct threadPool_s;
+
+#define MANIFEST_MAXNAME 64
+#define MANIFEST_MAXPALETTES 128
+#define MANIFEST_MAXDATS 64
+#define MANIFEST_MAXRULES 32
+
+struct manifestPalette_s //Palette source declared with "palette <name> <dat> <entry type> <entry id> [palette format]"
+{
+	char name[MANIFEST_MAXNAME];
+	char datPath[MAXPATH];
+	int entryType; //POP1_DATFORMAT_BIN if the palette is in a POP1 DAT
+	int entryId;
+	int palType; //Format we convert the palette data as
+	unsigned char *data; //Cached palette data (null until resolved)
+	unsigned int dataSize;
+};
+
+struct manifestRule_s //Declared with "rule <start id> <end id> <palette name>" (ids can be * for no bound, and palette name can be "auto")
+{
+	int startId;
+	int endId;
+	int paletteIdx; //-1 for automatic palette
+};
+
+struct manifestDAT_s //Declared with "dat <path>". Rules following this line belong to this DAT.
+{
+	char path[MAXPATH];
+	manifestRule_s rules[MANIFEST_MAXRULES];
+	int ruleCount;
+};
+
+struct manifest_s
+{
+	bool pop1; //Set with "game pop1" or "game pop2"
+	bool gameDefined;
+	manifestPalette_s palettes[MANIFEST_MAXPALETTES];
+	int paletteCount;
+	manifestDAT_s dats[MANIFEST_MAXDATS];
+	int datCount;
+};
+
+manifest_s *Prince_LoadExtractionManifest(const char *path);
+manifest_s *Prince_LoadDefaultExtractionManifest(bool pop1);
+bool Prince_WriteDefaultExtractionManifest(const char *path, bool pop1);
+bool Prince_ResolveManifestPalettes(manifest_s *manifest);
+bool Prince_RunExtractionManifest(manifest_s *manifest, threadPool_s *pool = 0); //If pool is defined, palettes and DATs are processed as tasks on the pool
+void Prince_FreeExtractionManifest(manifest_s *manifest);
\ No newline at end of file
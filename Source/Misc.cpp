@@ -15,12 +15,19 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
-#include <direct.h>
-#include <Windows.h>
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
-#include "misc.h"
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include "Platform.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include "Misc.h"
 #include "lodepng.h"
 
 #define TAB 0x09
@@ -86,17 +93,155 @@ bool ReadFile(const char *fileName, unsigned char **data, unsigned int *dataSize
 	fopen_s(&file, fileName, "rb");
 	if(!file)
 		return 0;
-	fpos_t fpos = 0;
 	_fseeki64(file, 0, SEEK_END);
-	fgetpos(file, &fpos);
+	*dataSize = (unsigned int) _ftelli64(file);
 	_fseeki64(file, 0, SEEK_SET);
-	*dataSize = (unsigned int) fpos;
 	*data = new unsigned char[*dataSize];
 	fread(*data, *dataSize, 1, file);
 	fclose(file);
 	return 1;
 }
 
+bool MapFileForReading(const char *fileName, mappedFile_s *mappedFile) //Maps the whole file as read-only memory. Falls back to reading the file into a heap buffer if mapping fails.
+{
+	memset(mappedFile, 0, sizeof(mappedFile_s));
+
+#ifdef _WIN32
+	HANDLE fileHandle = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(fileHandle == INVALID_HANDLE_VALUE)
+		return 0;
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0 || fileSize.QuadPart > 0xFFFFFFFF) //Empty files can't be mapped, and DAT offsets are 32-bit anyway
+	{
+		CloseHandle(fileHandle);
+		return 0;
+	}
+	mappedFile->size = (unsigned int) fileSize.QuadPart;
+
+	HANDLE mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(mappingHandle)
+	{
+		mappedFile->data = (unsigned char *) MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+		if(mappedFile->data)
+		{
+			mappedFile->fileHandle = fileHandle;
+			mappedFile->mappingHandle = mappingHandle;
+			return 1;
+		}
+		CloseHandle(mappingHandle);
+	}
+	CloseHandle(fileHandle);
+#else
+	int fileDescriptor = open(fileName, O_RDONLY);
+	if(fileDescriptor == -1)
+		return 0;
+	struct stat fileInfo;
+	if(fstat(fileDescriptor, &fileInfo) != 0 || fileInfo.st_size == 0 || (unsigned long long) fileInfo.st_size > 0xFFFFFFFF) //Empty files can't be mapped, and DAT offsets are 32-bit anyway
+	{
+		close(fileDescriptor);
+		return 0;
+	}
+	mappedFile->size = (unsigned int) fileInfo.st_size;
+
+#ifdef POSIX_FADV_WILLNEED
+	posix_fadvise(fileDescriptor, 0, 0, POSIX_FADV_WILLNEED); //Every entry is going to be read, so start pulling the whole file into the page cache right away
+#endif
+	void *mapping = mmap(0, mappedFile->size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	close(fileDescriptor); //The mapping holds its own reference to the file
+	if(mapping != MAP_FAILED)
+	{
+		mappedFile->data = (unsigned char *) mapping;
+		return 1;
+	}
+#endif
+
+	//Mapping failed (this can happen when we're short on address space), so read the whole file instead
+	unsigned char *data = 0;
+	unsigned int dataSize = 0;
+	if(!ReadFile(fileName, &data, &dataSize) || dataSize != mappedFile->size)
+	{
+		if(data)
+			delete[]data;
+		memset(mappedFile, 0, sizeof(mappedFile_s));
+		return 0;
+	}
+	mappedFile->data = data;
+	mappedFile->isHeapCopy = 1;
+	return 1;
+}
+
+void UnmapFile(mappedFile_s *mappedFile)
+{
+	if(mappedFile->isHeapCopy)
+		delete[]mappedFile->data;
+	else
+	{
+#ifdef _WIN32
+		if(mappedFile->data)
+			UnmapViewOfFile(mappedFile->data);
+		if(mappedFile->mappingHandle)
+			CloseHandle((HANDLE) mappedFile->mappingHandle);
+		if(mappedFile->fileHandle)
+			CloseHandle((HANDLE) mappedFile->fileHandle);
+#else
+		if(mappedFile->data)
+			munmap(mappedFile->data, mappedFile->size);
+#endif
+	}
+	memset(mappedFile, 0, sizeof(mappedFile_s));
+}
+
+bool GetFileSizeAndModifiedTime(const char *fileName, unsigned long long *size, unsigned long long *modifiedTime) //Modification time is only meant to be compared against an earlier time for the same file (the unit depends on the platform)
+{
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA fileInfo;
+	if(!GetFileAttributesExA(fileName, GetFileExInfoStandard, &fileInfo))
+		return 0;
+	*size = ((unsigned long long) fileInfo.nFileSizeHigh << 32) | fileInfo.nFileSizeLow;
+	*modifiedTime = ((unsigned long long) fileInfo.ftLastWriteTime.dwHighDateTime << 32) | fileInfo.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat fileInfo;
+	if(stat(fileName, &fileInfo) != 0)
+		return 0;
+	*size = (unsigned long long) fileInfo.st_size;
+#ifdef __linux__
+	*modifiedTime = (unsigned long long) fileInfo.st_mtim.tv_sec * 1000000000 + fileInfo.st_mtim.tv_nsec;
+#else
+	*modifiedTime = (unsigned long long) fileInfo.st_mtime;
+#endif
+#endif
+	return 1;
+}
+
+bool RenameFile(const char *oldFileName, const char *newFileName) //Replaces newFileName if it already exists
+{
+#ifdef _WIN32
+	return MoveFileExA(oldFileName, newFileName, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(oldFileName, newFileName) == 0;
+#endif
+}
+
+unsigned char *ReserveScratchBuffer(scratchBuffer_s *buffer, unsigned int size) //Returns a buffer of at least "size" bytes. Only reallocates if the current buffer is too small, and old content isn't kept when that happens.
+{
+	if(buffer->size < size)
+	{
+		if(buffer->data)
+			delete[]buffer->data;
+		buffer->data = new unsigned char[size];
+		buffer->size = size;
+	}
+	return buffer->data;
+}
+
+void FreeScratchBuffer(scratchBuffer_s *buffer)
+{
+	if(buffer->data)
+		delete[]buffer->data;
+	buffer->data = 0;
+	buffer->size = 0;
+}
+
 unsigned char CharToHex(const char *bytes, int offset)
 {
 	unsigned char value = 0;
@@ -300,46 +445,254 @@ void RemoveSpacesAtStart(char *str)
 }
 
 #define MAXSTATUSUPDATETEXTSIZE 260
+static std::mutex statusMutex; //Keeps lines from different threads from getting mixed together
+static thread_local statusLog_s *statusCapture = 0;
+
+static void AppendToStatusLog(statusLog_s *log, const char *text, unsigned int length)
+{
+	if(log->length + length + 1 > log->size)
+	{
+		unsigned int newSize = (log->size * 2) + length + 1;
+		char *newText = new char[newSize];
+		if(log->text)
+		{
+			memcpy(newText, log->text, log->length);
+			delete[]log->text;
+		}
+		log->text = newText;
+		log->size = newSize;
+	}
+	memcpy(&log->text[log->length], text, length);
+	log->length += length;
+	log->text[log->length] = 0;
+}
+
 void StatusUpdate(const char *text, ...)
 {
 	char str[MAXSTATUSUPDATETEXTSIZE];
-	va_list	argumentPtr = NULL;
+	va_list	argumentPtr;
 	va_start(argumentPtr, text);
 	vsnprintf_s(str, MAXSTATUSUPDATETEXTSIZE, _TRUNCATE, text, argumentPtr);
 	va_end(argumentPtr);
+	if(statusCapture)
+	{
+		AppendToStatusLog(statusCapture, str, (unsigned int) strlen(str));
+		AppendToStatusLog(statusCapture, "\n", 1);
+		return;
+	}
+	statusMutex.lock();
 	printf("%s\n", str);
+	statusMutex.unlock();
 }
 
-bool SaveImageAsPNG(char *path, unsigned char *imgData, unsigned int width, unsigned int height, unsigned char channels) //This takes raw RGB or RGBA image data as input
+statusLog_s *CaptureStatusUpdates(statusLog_s *log)
 {
-	MakeDirectory_PathEndsWithFile(path);
-	FILE *file;
-	fopen_s(&file, path, "wb");
-	if(!file)
+	statusLog_s *prevLog = statusCapture;
+	statusCapture = log;
+	return prevLog;
+}
+
+unsigned long long TimeInMicroseconds()
+{
+	return (unsigned long long) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void FlushStatusLog(statusLog_s *log)
+{
+	if(log->text && statusCapture && statusCapture != log)
+	{
+		AppendToStatusLog(statusCapture, log->text, log->length);
+		delete[]log->text;
+	}
+	else if(log->text)
 	{
-		StatusUpdate("Warning: Failed to open %s for writing during SaveImageAsPNG()", path);
+		statusMutex.lock();
+		fwrite(log->text, log->length, 1, stdout);
+		statusMutex.unlock();
+		delete[]log->text;
+	}
+	log->text = 0;
+	log->length = 0;
+	log->size = 0;
+}
+
+struct pngProfile_s
+{
+	const char *name;
+	LodePNGFilterStrategy filterStrategy;
+	unsigned int windowSize;
+	unsigned int niceMatch; //Stop searching for a longer match once we've found one this long
+	bool lazyMatching;
+};
+
+static const pngProfile_s pngProfiles[PNGPROFILE_COUNT] = //Every profile keeps lodepng's automatic colour type. Our images almost always fit in a palette, and deflating RGBA takes longer than finding the palette does
+{
+	{"fastest", LFS_ZERO, 256, 8, 0},
+	{"fast", LFS_ONE, 512, 16, 1},
+	{"default", LFS_MINSUM, 2048, 128, 1}, //Lodepng's own defaults
+	{"smallest", LFS_MINSUM, 32768, 258, 1},
+};
+
+static int pngProfile = PNGPROFILE_FAST;
+static unsigned int pngThreads = 1;
+
+void SetPNGProfile(int profile)
+{
+	pngProfile = profile;
+}
+
+void SetPNGThreads(int threads)
+{
+	if(threads <= 0)
+		threads = (int) std::thread::hardware_concurrency();
+	pngThreads = threads > 0 ? threads : 1;
+}
+
+int PNGProfileFromName(const char *name)
+{
+	for(int i = 0; i < PNGPROFILE_COUNT; i++)
+	{
+		if(_stricmp(name, pngProfiles[i].name) == 0)
+			return i;
+	}
+	return -1;
+}
+
+static void ApplyPNGProfile(LodePNGEncoderSettings *settings)
+{
+	const pngProfile_s *profile = &pngProfiles[pngProfile];
+	settings->filter_strategy = profile->filterStrategy;
+	settings->zlibsettings.windowsize = profile->windowSize;
+	settings->zlibsettings.nicematch = profile->niceMatch;
+	settings->zlibsettings.lazymatching = profile->lazyMatching;
+	settings->zlibsettings.threads = pngThreads;
+}
+
+bool EncodeImageAsPNG(const unsigned char *imgData, unsigned int width, unsigned int height, unsigned char channels, unsigned char **pngData, size_t *pngDataSize) //This takes raw RGB or RGBA image data as input. pngData has to be freed with free()
+{
+	*pngData = 0;
+	*pngDataSize = 0;
+	if(channels != 3 && channels != 4)
+	{
+		StatusUpdate("Warning: Can't encode image with %u channels as PNG", channels);
 		return 0;
 	}
-	unsigned char *pngData = 0;
-	size_t pngDataSize;
-	unsigned int error;
-	if(channels == 3)
-		error = lodepng_encode24(&pngData, &pngDataSize, imgData, width, height);
-	else if(channels == 4)
-		error = lodepng_encode32(&pngData, &pngDataSize, imgData, width, height);
+
+	LodePNGState state;
+	lodepng_state_init(&state);
+	ApplyPNGProfile(&state.encoder);
+	state.info_raw.colortype = channels == 3 ? LCT_RGB : LCT_RGBA;
+	state.info_raw.bitdepth = 8;
+	unsigned int error = lodepng_encode(pngData, pngDataSize, imgData, width, height, &state);
+	lodepng_state_cleanup(&state);
 	if(error)
 	{
 		StatusUpdate("Lodepng error %u: %s\n", error, lodepng_error_text(error));
-		fclose(file);
+		if(*pngData)
+			free(*pngData);
+		*pngData = 0;
 		return 0;
 	}
-	fwrite(pngData, pngDataSize, 1, file);
-	free(pngData);
+	return 1;
+}
+
+bool EncodeIndexedImageAsPNG(const unsigned char *indexData, unsigned int width, unsigned int height, const unsigned int *paletteRGBA, unsigned int colourCount, unsigned char **pngData, size_t *pngDataSize) //This takes one 8-bit palette index per pixel and writes a colour type 3 PNG. paletteRGBA holds colourCount colours as RGBA bytes, but only the ones up to the highest index in use are written. pngData has to be freed with free()
+{
+	*pngData = 0;
+	*pngDataSize = 0;
+	if(colourCount == 0 || colourCount > 256)
+	{
+		StatusUpdate("Warning: Invalid palette size %u for indexed PNG", colourCount);
+		return 0;
+	}
+
+	//Only write the palette up to the highest index that's in use, and use the smallest bit depth that fits it
+	unsigned int pixelCount = width * height;
+	unsigned char maxIndex = 0;
+	for(unsigned int i = 0; i < pixelCount; i++)
+	{
+		if(indexData[i] > maxIndex)
+			maxIndex = indexData[i];
+	}
+	if(maxIndex >= colourCount)
+	{
+		StatusUpdate("Warning: Image uses palette index %u, but the palette only has %u colours", maxIndex, colourCount);
+		return 0;
+	}
+	colourCount = maxIndex + 1;
+	unsigned int bitDepth = colourCount <= 2 ? 1 : colourCount <= 4 ? 2 : colourCount <= 16 ? 4 : 8;
+
+	//Pack indices ourselves so the raw and PNG colour modes are identical, which means lodepng uses the data as is instead of looking up every pixel in the palette. Lodepng wants packed pixels without any padding at the end of rows
+	unsigned char *packedData = (unsigned char *) indexData;
+	if(bitDepth < 8)
+	{
+		unsigned int pixelsPerByte = 8 / bitDepth;
+		unsigned int packedSize = (pixelCount + pixelsPerByte - 1) / pixelsPerByte;
+		packedData = new unsigned char[packedSize];
+		memset(packedData, 0, packedSize);
+		for(unsigned int i = 0; i < pixelCount; i++)
+			packedData[i / pixelsPerByte] |= indexData[i] << (8 - bitDepth - (i % pixelsPerByte) * bitDepth);
+	}
+
+	LodePNGState state;
+	lodepng_state_init(&state);
+	ApplyPNGProfile(&state.encoder);
+	state.encoder.auto_convert = 0;
+	state.info_raw.colortype = LCT_PALETTE;
+	state.info_raw.bitdepth = bitDepth;
+	state.info_png.color.colortype = LCT_PALETTE;
+	state.info_png.color.bitdepth = bitDepth;
+	unsigned int error = 0;
+	for(unsigned int i = 0; i < colourCount && !error; i++) //Lodepng writes a tRNS chunk by itself if any palette entry isn't opaque
+	{
+		const unsigned char *colour = (const unsigned char *) &paletteRGBA[i];
+		error = lodepng_palette_add(&state.info_raw, colour[0], colour[1], colour[2], colour[3]);
+		if(!error)
+			error = lodepng_palette_add(&state.info_png.color, colour[0], colour[1], colour[2], colour[3]);
+	}
+	if(!error)
+		error = lodepng_encode(pngData, pngDataSize, packedData, width, height, &state);
+	lodepng_state_cleanup(&state);
+	if(packedData != indexData)
+		delete[]packedData;
+	if(error)
+	{
+		StatusUpdate("Lodepng error %u: %s\n", error, lodepng_error_text(error));
+		if(*pngData)
+			free(*pngData);
+		*pngData = 0;
+		return 0;
+	}
+	return 1;
+}
+
+bool WriteDataToFile(char *path, const unsigned char *data, size_t dataSize)
+{
+	MakeDirectory_PathEndsWithFile(path);
+	FILE *file;
+	fopen_s(&file, path, "wb");
+	if(!file)
+	{
+		StatusUpdate("Warning: Failed to open %s for writing.", path);
+		return 0;
+	}
+	fwrite(data, dataSize, 1, file);
 	fclose(file);
 	StatusUpdate("Wrote %s", path);
 	return 1;
 }
 
+bool SaveImageAsPNG(char *path, unsigned char *imgData, unsigned int width, unsigned int height, unsigned char channels) //This takes raw RGB or RGBA image data as input
+{
+	unsigned char *pngData = 0;
+	size_t pngDataSize;
+	if(!EncodeImageAsPNG(imgData, width, height, channels, &pngData, &pngDataSize))
+		return 0;
+	bool success = WriteDataToFile(path, pngData, pngDataSize);
+	free(pngData);
+	return success;
+}
+
 //Make directory. This version handles a path with a file, so it'll not add a directory with file name. (TODO: This should be obsolete! Replace this with below function and confirm code still works, then remove this function)
 void MakeDirectory_PathEndsWithFile(char *fullpath, int pos)
 {
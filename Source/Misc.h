@@ -31,6 +31,39 @@ enum
 	RV_BOOL
 };
 
+//PNG encode profiles
+enum
+{
+	PNGPROFILE_FASTEST, //No filtering, tiny window and no lazy matching
+	PNGPROFILE_FAST, //Sub filter, small window and short lazy matching
+	PNGPROFILE_DEFAULT, //Lodepng's default settings
+	PNGPROFILE_SMALLEST, //Biggest window and longest matches
+
+	PNGPROFILE_COUNT
+};
+
+struct mappedFile_s
+{
+	unsigned char *data;
+	unsigned int size;
+	void *fileHandle; //Windows file handle for the mapped file (null on other platforms, where the file is closed as soon as it's mapped)
+	void *mappingHandle; //Windows file mapping handle (null on other platforms)
+	bool isHeapCopy; //True if mapping failed and data was read into a heap buffer instead
+};
+
+struct scratchBuffer_s //Grow-only buffer that can be reused for data of varying size
+{
+	unsigned char *data;
+	unsigned int size; //Allocated size
+};
+
+struct statusLog_s //Holds StatusUpdate() text from one thread so it can be printed later in a fixed order
+{
+	char *text;
+	unsigned int length;
+	unsigned int size; //Allocated size
+};
+
 extern char r_str[FILESTRINGMAX]; //String used by ReadValue
 extern float r_float; //Value used by ReadValue
 extern int r_int; //Value used by ReadValue
@@ -40,6 +73,12 @@ int LastSlash(char *path);
 int LastDot(char *path);
 int FirstDot(char *path);
 bool ReadFile(const char *fileName, unsigned char **data, unsigned int *dataSize);
+bool MapFileForReading(const char *fileName, mappedFile_s *mappedFile);
+void UnmapFile(mappedFile_s *mappedFile);
+bool GetFileSizeAndModifiedTime(const char *fileName, unsigned long long *size, unsigned long long *modifiedTime);
+bool RenameFile(const char *oldFileName, const char *newFileName);
+unsigned char *ReserveScratchBuffer(scratchBuffer_s *buffer, unsigned int size);
+void FreeScratchBuffer(scratchBuffer_s *buffer);
 unsigned char CharToHex(const char *bytes, int offset = 0);
 void CharByteToData(char *num, unsigned char *c, int size, bool littleEndian); //Note, num size has to be twice the size of "size" otherwise this function fails
 bool IsNumber(char *str);
@@ -51,6 +90,15 @@ char *ReturnStringPos(char *find, char *in); //Find position of "find" string wi
 void RemoveSpacesAtEnd(char *str);
 void RemoveSpacesAtStart(char *str);
 void StatusUpdate(const char *text, ...);
+statusLog_s *CaptureStatusUpdates(statusLog_s *log); //StatusUpdate() calls from the calling thread go into log instead of being printed. Pass 0 to print directly again. Returns previous log so it can be restored
+unsigned long long TimeInMicroseconds(); //Monotonic clock for measuring how long something takes
+void FlushStatusLog(statusLog_s *log); //Prints everything in log (or adds it to the calling thread's log if it has one) and frees it
+void SetPNGProfile(int profile); //Used by every PNG encode after this. Default is PNGPROFILE_FAST
+int PNGProfileFromName(const char *name); //Returns -1 if there's no profile with that name
+void SetPNGThreads(int threads); //Big PNGs are compressed on this many threads at the same time (0 means one per hardware thread). Default is 1
+bool EncodeImageAsPNG(const unsigned char *imgData, unsigned int width, unsigned int height, unsigned char channels, unsigned char **pngData, size_t *pngDataSize);
+bool EncodeIndexedImageAsPNG(const unsigned char *indexData, unsigned int width, unsigned int height, const unsigned int *paletteRGBA, unsigned int colourCount, unsigned char **pngData, size_t *pngDataSize);
+bool WriteDataToFile(char *path, const unsigned char *data, size_t dataSize);
 bool SaveImageAsPNG(char *path, unsigned char *imgData, unsigned int width, unsigned int height, unsigned char channels);
 void MakeDirectory_PathEndsWithFile(char *fullpath, int pos = 0);
 void DataToHex(char *to, char *from, int size, bool swapEndian = 0);
@@ -0,0 +1,90 @@
+/*
+Copyright (C) 2023 FluffyQuack
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <stdint.h>
+#include <mutex>
+#include "Vars.h"
+#include "Palette.h"
+
+#define PALETTE_BUCKETCOUNT 64
+
+struct paletteEntry_s
+{
+	princePalette_s palette; //Has to be first as we get back to the entry from the palette pointer we handed out
+	int refCount;
+	paletteEntry_s *next; //Next entry in the same bucket
+	unsigned char *allocation; //What we got from new, as the entry itself is moved up to a cache line boundary
+};
+
+static std::mutex paletteMutex;
+static paletteEntry_s *paletteBuckets[PALETTE_BUCKETCOUNT]; //Every palette that's in use, found by hash
+
+static unsigned long long HashPalette(const unsigned int *rgba) //64-bit FNV-1a
+{
+	const unsigned char *bytes = (const unsigned char *) rgba;
+	unsigned long long hash = 14695981039346656037ULL;
+	for(int i = 0; i < 256 * 4; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+const princePalette_s *Prince_CompilePalette(const unsigned int *rgba)
+{
+	unsigned long long hash = HashPalette(rgba);
+	paletteEntry_s **bucket = &paletteBuckets[hash % PALETTE_BUCKETCOUNT];
+	paletteMutex.lock();
+	for(paletteEntry_s *entry = *bucket; entry; entry = entry->next)
+	{
+		if(entry->palette.hash == hash && memcmp(entry->palette.rgba, rgba, sizeof(entry->palette.rgba)) == 0)
+		{
+			entry->refCount++;
+			paletteMutex.unlock();
+			return &entry->palette;
+		}
+	}
+
+	//new doesn't respect alignas() before C++17, so we line the entry up ourselves
+	unsigned char *allocation = new unsigned char[sizeof(paletteEntry_s) + alignof(paletteEntry_s) - 1];
+	paletteEntry_s *entry = (paletteEntry_s *) (((uintptr_t) allocation + alignof(paletteEntry_s) - 1) & ~(uintptr_t) (alignof(paletteEntry_s) - 1));
+	memcpy(entry->palette.rgba, rgba, sizeof(entry->palette.rgba));
+	entry->palette.hash = hash;
+	entry->refCount = 1;
+	entry->allocation = allocation;
+	entry->next = *bucket;
+	*bucket = entry;
+	paletteMutex.unlock();
+	return &entry->palette;
+}
+
+void Prince_ReleasePalette(const princePalette_s *palette)
+{
+	paletteEntry_s *entry = (paletteEntry_s *) palette;
+	paletteMutex.lock();
+	if(--entry->refCount == 0)
+	{
+		paletteEntry_s **link = &paletteBuckets[palette->hash % PALETTE_BUCKETCOUNT];
+		while(*link != entry)
+			link = &(*link)->next;
+		*link = entry->next;
+		delete[]entry->allocation;
+	}
+	paletteMutex.unlock();
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+/*
+Copyright (C) 2023 FluffyQuack
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+struct princePalette_s;
+
+const princePalette_s *Prince_CompilePalette(const unsigned int *rgba); //Returns the shared palette with these 256 RGBA colours, and builds it if nobody has one with the same colours. Release it with Prince_ReleasePalette()
+void Prince_ReleasePalette(const princePalette_s *palette);
\ No newline at end of file
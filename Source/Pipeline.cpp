@@ -0,0 +1,348 @@
+/*
+Copyright (C) 2023 FluffyQuack
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include "Platform.h"
+#include "Misc.h"
+#include "Vars.h"
+#include "DAT-Formats.h"
+#include "ThreadPool.h"
+#include "Pipeline.h"
+#include "ImageWriters.h"
+#include "ImageCache.h"
+
+struct pipelineSlot_s //One queued file. Images go through the decode and encode stages before they can be written.
+{
+	extractPipeline_s *pipeline;
+	char path[MAX_PATH];
+	const unsigned char *data; //Points into the mapped DAT, or to the encoded image file for images
+	size_t dataSize;
+	bool isImage;
+	const unsigned char *srcImgData; //Points into the mapped DAT
+	unsigned int srcImgDataSize;
+	const princePalette_s *palette;
+	int entryId; //Used to find the image in the image cache (-1 if we don't cache it)
+	princeCachedImage_s *cachedImage; //Held from the decode stage until the encode stage is done with it
+	princeImageScratch_s scratch; //Reused by every image that goes through this slot
+	unsigned char *imgData; //Decoded image as RGBA, or as palette indices if we write indexed PNGs (points into scratch)
+	unsigned int width;
+	unsigned int height;
+	unsigned char channels;
+	unsigned int colourCount; //Palette entries the image can refer to (indexed PNG output only)
+	unsigned char *encodedData; //Image encoded as PNG, QOI or TGA
+	bool converted;
+	statusLog_s preLog; //Output from the owning thread that came before this slot was queued
+	statusLog_s log; //Output from the decode and encode stages
+	poolTask_s *writeTask; //Handle is owned by the slot and released when the slot is reused or the pipeline finishes
+};
+
+struct extractPipeline_s
+{
+	threadPool_s *pool;
+	princeImageCache_s *imageCache;
+	char archive[MAX_PATH]; //Identifies the DAT in the image cache
+	pipelineSlot_s *slots; //Ring buffer. This bounds how many entries can be between the read and write stages
+	int slotCount;
+	int first;
+	int count;
+	poolTask_s *lastWriteTask; //Every write depends on the previous one so files are written in the order they were queued. Borrowed from the newest slot, which is never the one being reused since there are at least two slots when we have a pool
+	std::atomic<bool> failed;
+	statusLog_s ownerLog; //Output from the owning thread since the last slot was queued. It's printed along with the next write so the order stays the same as if we did everything right away
+	statusLog_s *prevLog; //Where output went before the pipeline was created
+	unsigned long long startTime;
+	unsigned long long waitTime; //Time the owning thread spent waiting for other stages
+};
+
+static bool indexedPNG = 0;
+static bool statsEnabled = 0;
+static unsigned long long statsStartTime = 0;
+static std::atomic<unsigned long long> stageTime[PIPELINE_STAGECOUNT]; //Microseconds spent in each stage, summed over all threads
+static std::atomic<unsigned int> stageItems[PIPELINE_STAGECOUNT];
+static std::atomic<unsigned long long> stallTime; //Microseconds owning threads spent waiting for a free slot
+static std::atomic<unsigned long long> occupancySum; //Slots in use, sampled every time a slot is queued
+static std::atomic<unsigned int> occupancySamples;
+static std::atomic<int> occupancyMax;
+static std::atomic<int> slotCountMax;
+
+static void UpdateMax(std::atomic<int> *max, int value)
+{
+	int current = max->load();
+	while(value > current && !max->compare_exchange_weak(current, value));
+}
+
+static unsigned long long StageStart()
+{
+	return statsEnabled ? TimeInMicroseconds() : 0;
+}
+
+static void StageEnd(int stage, unsigned long long start)
+{
+	if(!statsEnabled)
+		return;
+	stageTime[stage] += TimeInMicroseconds() - start;
+	stageItems[stage]++;
+}
+
+static void DecodeSlot(void *param)
+{
+	pipelineSlot_s *slot = (pipelineSlot_s *) param;
+	unsigned long long start = StageStart();
+	statusLog_s *prevLog = CaptureStatusUpdates(&slot->log);
+	unsigned int imgDataSize = 0;
+	princeImageCache_s *imageCache = slot->pipeline->imageCache;
+	if(imageCache && slot->entryId != -1) //Decode image once no matter how many palettes it's rendered with
+	{
+		princeCachedImage_s *cachedImage = Prince_AcquireCachedImage(imageCache, slot->pipeline->archive, slot->entryId, slot->srcImgData, slot->srcImgDataSize, &slot->scratch);
+		const princeIndexedImage_s *image = cachedImage ? Prince_CachedImageData(cachedImage) : 0;
+		slot->converted = image != 0;
+		if(image && indexedPNG) //Indices are encoded straight from the cache
+		{
+			slot->cachedImage = cachedImage;
+			slot->imgData = image->indices;
+			slot->width = image->width;
+			slot->height = image->height;
+			slot->colourCount = image->colourCount;
+		}
+		else if(image)
+		{
+			slot->converted = Prince_RenderIndexedImage(image, slot->palette, &slot->imgData, &imgDataSize, &slot->channels, &slot->scratch);
+			slot->width = image->width;
+			slot->height = image->height;
+			Prince_ReleaseCachedImage(imageCache, cachedImage);
+		}
+	}
+	else if(indexedPNG)
+		slot->converted = Prince_DecodePOPImageIndices(slot->srcImgData, slot->srcImgDataSize, &slot->imgData, &slot->width, &slot->height, &slot->colourCount, 0, &slot->scratch);
+	else
+		slot->converted = Prince_ConvPOPImageData(slot->srcImgData, slot->srcImgDataSize, slot->palette, &slot->imgData, &imgDataSize, &slot->width, &slot->height, &slot->channels, 0, &slot->scratch);
+	CaptureStatusUpdates(prevLog);
+	StageEnd(PIPELINE_STAGE_DECODE, start);
+}
+
+static void EncodeSlot(void *param)
+{
+	pipelineSlot_s *slot = (pipelineSlot_s *) param;
+	if(!slot->converted)
+		return;
+	unsigned long long start = StageStart();
+	statusLog_s *prevLog = CaptureStatusUpdates(&slot->log);
+	if(indexedPNG)
+		slot->converted = EncodeIndexedImageAsPNG(slot->imgData, slot->width, slot->height, slot->palette->rgba, slot->colourCount, &slot->encodedData, &slot->dataSize);
+	else
+		slot->converted = EncodeImage(slot->imgData, slot->width, slot->height, slot->channels, &slot->encodedData, &slot->dataSize);
+	slot->data = slot->encodedData;
+	if(slot->cachedImage)
+	{
+		Prince_ReleaseCachedImage(slot->pipeline->imageCache, slot->cachedImage);
+		slot->cachedImage = 0;
+	}
+	CaptureStatusUpdates(prevLog);
+	StageEnd(PIPELINE_STAGE_ENCODE, start);
+}
+
+static void WriteSlot(void *param)
+{
+	pipelineSlot_s *slot = (pipelineSlot_s *) param;
+	extractPipeline_s *pipeline = slot->pipeline;
+	unsigned long long start = StageStart();
+	statusLog_s *prevLog = CaptureStatusUpdates(pipeline->prevLog); //Writes are done one at a time, and the owning thread doesn't use this log while the pipeline exists
+	FlushStatusLog(&slot->preLog);
+	FlushStatusLog(&slot->log);
+	if(slot->isImage && !slot->converted)
+		pipeline->failed = 1;
+	else if(!WriteDataToFile(slot->path, slot->data, slot->dataSize))
+		pipeline->failed = 1;
+	if(slot->encodedData)
+		free(slot->encodedData);
+	slot->encodedData = 0;
+	CaptureStatusUpdates(prevLog);
+	StageEnd(PIPELINE_STAGE_WRITE, start);
+}
+
+static void WaitForWrite(extractPipeline_s *pipeline, poolTask_s *task)
+{
+	unsigned long long start = StageStart();
+	ThreadPool_WaitForTask(pipeline->pool, task);
+	if(statsEnabled)
+		pipeline->waitTime += TimeInMicroseconds() - start;
+}
+
+static pipelineSlot_s *QueueSlot(extractPipeline_s *pipeline) //Waits for the oldest write if every slot is in use
+{
+	if(pipeline->count == pipeline->slotCount)
+	{
+		pipelineSlot_s *oldest = &pipeline->slots[pipeline->first];
+		if(oldest->writeTask)
+		{
+			unsigned long long waitStart = pipeline->waitTime;
+			WaitForWrite(pipeline, oldest->writeTask);
+			stallTime += pipeline->waitTime - waitStart;
+			ThreadPool_ReleaseTask(oldest->writeTask);
+		}
+		oldest->writeTask = 0;
+		pipeline->first = (pipeline->first + 1) % pipeline->slotCount;
+		pipeline->count--;
+	}
+	pipelineSlot_s *slot = &pipeline->slots[(pipeline->first + pipeline->count) % pipeline->slotCount];
+	pipeline->count++;
+	if(statsEnabled)
+	{
+		stageItems[PIPELINE_STAGE_READ]++;
+		occupancySum += pipeline->count;
+		occupancySamples++;
+		UpdateMax(&occupancyMax, pipeline->count);
+	}
+	slot->preLog = pipeline->ownerLog;
+	memset(&pipeline->ownerLog, 0, sizeof(statusLog_s));
+	return slot;
+}
+
+static void SubmitSlot(extractPipeline_s *pipeline, pipelineSlot_s *slot)
+{
+	if(!pipeline->pool) //Do everything right away
+	{
+		if(slot->isImage)
+		{
+			DecodeSlot(slot);
+			EncodeSlot(slot);
+		}
+		WriteSlot(slot);
+		return;
+	}
+
+	poolTask_s *writeTask = ThreadPool_CreateTask(pipeline->pool, WriteSlot, slot);
+	if(pipeline->lastWriteTask)
+		ThreadPool_AddDependency(writeTask, pipeline->lastWriteTask);
+	if(slot->isImage)
+	{
+		poolTask_s *decodeTask = ThreadPool_CreateTask(pipeline->pool, DecodeSlot, slot);
+		poolTask_s *encodeTask = ThreadPool_CreateTask(pipeline->pool, EncodeSlot, slot);
+		ThreadPool_AddDependency(encodeTask, decodeTask);
+		ThreadPool_AddDependency(writeTask, encodeTask);
+		ThreadPool_Submit(pipeline->pool, decodeTask);
+		ThreadPool_Submit(pipeline->pool, encodeTask);
+		ThreadPool_ReleaseTask(decodeTask);
+		ThreadPool_ReleaseTask(encodeTask);
+	}
+	ThreadPool_Submit(pipeline->pool, writeTask);
+	slot->writeTask = writeTask;
+	pipeline->lastWriteTask = writeTask;
+}
+
+extractPipeline_s *Pipeline_Create(threadPool_s *pool)
+{
+	extractPipeline_s *pipeline = new extractPipeline_s;
+	pipeline->pool = pool;
+	pipeline->imageCache = 0;
+	pipeline->archive[0] = 0;
+	pipeline->slotCount = pool ? ThreadPool_ThreadCount(pool) * 2 : 1; //Enough to keep every worker busy while the oldest file is being written
+	pipeline->slots = new pipelineSlot_s[pipeline->slotCount];
+	memset(pipeline->slots, 0, sizeof(pipelineSlot_s) * pipeline->slotCount);
+	for(int i = 0; i < pipeline->slotCount; i++)
+		pipeline->slots[i].pipeline = pipeline;
+	pipeline->first = 0;
+	pipeline->count = 0;
+	pipeline->lastWriteTask = 0;
+	pipeline->failed = 0;
+	memset(&pipeline->ownerLog, 0, sizeof(statusLog_s));
+	pipeline->prevLog = CaptureStatusUpdates(&pipeline->ownerLog);
+	pipeline->startTime = StageStart();
+	pipeline->waitTime = 0;
+	if(statsEnabled)
+		UpdateMax(&slotCountMax, pipeline->slotCount);
+	return pipeline;
+}
+
+bool Pipeline_QueueFile(extractPipeline_s *pipeline, const char *path, const unsigned char *data, unsigned int dataSize)
+{
+	pipelineSlot_s *slot = QueueSlot(pipeline);
+	strcpy_s(slot->path, MAX_PATH, path);
+	slot->isImage = 0;
+	slot->data = data;
+	slot->dataSize = dataSize;
+	SubmitSlot(pipeline, slot);
+	return !pipeline->failed;
+}
+
+void Pipeline_UseImageCache(extractPipeline_s *pipeline, princeImageCache_s *cache, const char *archive)
+{
+	pipeline->imageCache = cache;
+	strcpy_s(pipeline->archive, MAX_PATH, archive);
+}
+
+bool Pipeline_QueueImage(extractPipeline_s *pipeline, const char *path, const unsigned char *srcImgData, unsigned int srcImgDataSize, const princePalette_s *palette, int entryId)
+{
+	pipelineSlot_s *slot = QueueSlot(pipeline);
+	strcpy_s(slot->path, MAX_PATH, path);
+	slot->isImage = 1;
+	slot->srcImgData = srcImgData;
+	slot->srcImgDataSize = srcImgDataSize;
+	slot->palette = palette;
+	slot->entryId = entryId;
+	slot->converted = 0;
+	SubmitSlot(pipeline, slot);
+	return !pipeline->failed;
+}
+
+bool Pipeline_Finish(extractPipeline_s *pipeline)
+{
+	if(pipeline->lastWriteTask)
+		WaitForWrite(pipeline, pipeline->lastWriteTask);
+	CaptureStatusUpdates(pipeline->prevLog);
+	FlushStatusLog(&pipeline->ownerLog);
+	if(statsEnabled) //Anything the owning thread did while not waiting for other stages counts as reading
+		stageTime[PIPELINE_STAGE_READ] += TimeInMicroseconds() - pipeline->startTime - pipeline->waitTime;
+	bool success = !pipeline->failed;
+	for(int i = 0; i < pipeline->slotCount; i++)
+	{
+		if(pipeline->slots[i].writeTask) //Every write has finished since they run in order
+			ThreadPool_ReleaseTask(pipeline->slots[i].writeTask);
+		Prince_FreeImageScratch(&pipeline->slots[i].scratch);
+	}
+	delete[]pipeline->slots;
+	delete pipeline;
+	return success;
+}
+
+void Pipeline_UseIndexedPNG(bool enable)
+{
+	indexedPNG = enable;
+}
+
+void Pipeline_EnableStats()
+{
+	statsEnabled = 1;
+	statsStartTime = TimeInMicroseconds();
+}
+
+void Pipeline_PrintStats()
+{
+	if(!statsEnabled)
+		return;
+	static const char *stageNames[PIPELINE_STAGECOUNT] = {"Read", "Decode", "Encode", "Write"};
+	double elapsed = (TimeInMicroseconds() - statsStartTime) / 1000000.0;
+	StatusUpdate("Pipeline statistics (%.2f seconds in total, busy and waiting times are summed over all threads):", elapsed);
+	for(int i = 0; i < PIPELINE_STAGECOUNT; i++)
+	{
+		double busy = stageTime[i].load() / 1000000.0;
+		StatusUpdate("  %-7s %6u items  %8.2f seconds busy  %5.2f threads busy on average", stageNames[i], stageItems[i].load(), busy, elapsed > 0 ? busy / elapsed : 0);
+	}
+	unsigned int samples = occupancySamples.load();
+	StatusUpdate("  Queue   %.2f of %i slots in use on average, %i at most, %.2f seconds waiting for a free slot", samples ? (double) occupancySum.load() / samples : 0, slotCountMax.load(), occupancyMax.load(), stallTime.load() / 1000000.0);
+}
\ No newline at end of file
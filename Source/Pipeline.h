@@ -0,0 +1,41 @@
+/*
+Copyright (C) 2023 FluffyQuack
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+struct threadPool_s;
+struct princeImageCache_s;
+struct extractPipeline_s; //Staged pipeline for extracted files. The thread that owns it reads entries and queues them, images are decoded and encoded on the pool, and files are written on the pool in the order they were queued
+
+enum
+{
+	PIPELINE_STAGE_READ, //Reading entries and preparing palettes on the owning thread
+	PIPELINE_STAGE_DECODE, //Converting POP image data to RGBA (or palette indices)
+	PIPELINE_STAGE_ENCODE, //Encoding PNG, QOI or TGA
+	PIPELINE_STAGE_WRITE, //Writing files
+
+	PIPELINE_STAGECOUNT
+};
+
+extractPipeline_s *Pipeline_Create(threadPool_s *pool); //Without a pool, every stage runs right away on the calling thread
+bool Pipeline_QueueFile(extractPipeline_s *pipeline, const char *path, const unsigned char *data, unsigned int dataSize); //Data has to stay valid until the pipeline is finished. Returns 0 if a previous write failed
+void Pipeline_UseImageCache(extractPipeline_s *pipeline, princeImageCache_s *cache, const char *archive); //Images queued with an entry id after this are decoded through the cache, so an entry is only decompressed once even if it's queued with several palettes. Archive identifies the DAT the entries come from
+bool Pipeline_QueueImage(extractPipeline_s *pipeline, const char *path, const unsigned char *srcImgData, unsigned int srcImgDataSize, const princePalette_s *palette, int entryId = -1); //Converts POP image data and saves it in the format picked with SetImageFormat(). Palette can't change until the pipeline is finished. Returns 0 if a previous write failed
+bool Pipeline_Finish(extractPipeline_s *pipeline); //Waits for all queued files to be written and frees the pipeline. Returns 0 if any write failed
+void Pipeline_UseIndexedPNG(bool enable); //Write images as 8-bit palette PNGs (colour type 3) straight from the palette indices instead of expanding them to RGBA. Index 0 is transparent
+void Pipeline_EnableStats();
+void Pipeline_PrintStats();
\ No newline at end of file
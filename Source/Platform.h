@@ -0,0 +1,96 @@
+/*
+Copyright (C) 2023 FluffyQuack
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+//Lets the rest of the code use the Windows CRT names on every platform. Windows builds get the real headers, other platforms get thin wrappers around the POSIX calls
+
+#ifdef _WIN32
+#include <windows.h>
+#include <tchar.h>
+#include <direct.h>
+#include <process.h>
+
+#define PATHSEP "\\" //Separator used when we build paths ourselves
+#else
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PATHSEP "/" //Separator used when we build paths ourselves
+#define MAX_PATH PATH_MAX
+#define _TRUNCATE ((size_t) -1)
+#define _tmain main
+typedef char _TCHAR;
+
+inline int fopen_s(FILE **file, const char *fileName, const char *mode)
+{
+	*file = fopen(fileName, mode);
+	return *file ? 0 : errno;
+}
+
+inline int vsnprintf_s(char *buffer, size_t bufferSize, size_t /*count*/, const char *format, va_list argumentPtr) //Only the _TRUNCATE behaviour is supported, so count is ignored
+{
+	return vsnprintf(buffer, bufferSize, format, argumentPtr);
+}
+
+__attribute__((format(printf, 3, 4))) inline int sprintf_s(char *buffer, size_t bufferSize, const char *format, ...) //Truncates instead of calling an invalid parameter handler if the buffer is too small
+{
+	va_list argumentPtr;
+	va_start(argumentPtr, format);
+	int length = vsnprintf(buffer, bufferSize, format, argumentPtr);
+	va_end(argumentPtr);
+	return length;
+}
+
+inline int strcpy_s(char *dest, size_t destSize, const char *src) //Truncates instead of calling an invalid parameter handler if dest is too small
+{
+	snprintf(dest, destSize, "%s", src);
+	return 0;
+}
+
+inline int _stricmp(const char *string1, const char *string2)
+{
+	return strcasecmp(string1, string2);
+}
+
+inline int _mkdir(const char *path)
+{
+	return mkdir(path, 0777);
+}
+
+inline int _getpid()
+{
+	return (int) getpid();
+}
+
+inline int _fseeki64(FILE *file, long long offset, int origin)
+{
+	return fseeko(file, (off_t) offset, origin);
+}
+
+inline long long _ftelli64(FILE *file)
+{
+	return (long long) ftello(file);
+}
+#endif
\ No newline at end of file
@@ -16,8 +16,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <stdio.h>
-#include <tchar.h>
 #include <stdlib.h>
+#include "Platform.h"
 #include "Misc.h"
 #include "Vars.h"
 #include "DAT.h"
@@ -134,9 +134,9 @@ bool Prince_RepackDATv2(char *path)
 	//Read sequences.txt
 	char *scriptData = 0;
 	unsigned int scriptDataSize = 0;
-	if(!ReadFile("sequence\\sequences.txt", (unsigned char **) &scriptData, &scriptDataSize))
+	if(!ReadFile("sequence" PATHSEP "sequences.txt", (unsigned char **) &scriptData, &scriptDataSize))
 	{
-		StatusUpdate("Warning: Could not load sequence\\sequences.txt for reading.");
+		StatusUpdate("Warning: Could not load sequence" PATHSEP "sequences.txt for reading.");
 		return 0;
 	}
 
@@ -0,0 +1,278 @@
+/*
+Copyright (C) 2023 FluffyQuack
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include "ThreadPool.h"
+
+struct poolTask_s
+{
+	threadPool_s *pool; //Pool the task was created for. It can only be submitted to that pool and only depend on tasks from it
+	poolTaskFunc_t func;
+	void *param;
+	std::atomic<int> pendingCount; //Unfinished dependencies, plus one until the task is submitted
+	std::mutex mutex; //Protects finished and dependents
+	bool finished;
+	std::vector<poolTask_s*> dependents; //Tasks waiting for this one to finish
+	std::atomic<int> refCount; //One for the caller's handle and one until the task has finished
+};
+
+struct taskQueue_s
+{
+	std::mutex mutex;
+	std::deque<poolTask_s*> tasks; //Owner pushes and pops at the back, thieves take from the front
+};
+
+struct threadPool_s
+{
+	std::vector<std::thread> threads;
+	taskQueue_s *queues; //One per worker, plus one at the end for tasks submitted from outside the pool
+	int queueCount;
+	std::mutex sleepMutex;
+	std::condition_variable workCond; //Signalled when a task is queued
+	std::condition_variable doneCond; //Signalled when a task is queued or finishes
+	std::atomic<int> queuedCount;
+	std::atomic<int> waitingCount; //Threads sleeping in ThreadPool_WaitForTask()
+	std::atomic<int> unfinishedCount; //Tasks that have been submitted but not finished
+	bool quit;
+};
+
+static thread_local threadPool_s *currentPool = 0;
+static thread_local int currentQueue = -1;
+
+static void QueueTask(threadPool_s *pool, poolTask_s *task)
+{
+	int queueIdx = currentPool == pool ? currentQueue : pool->queueCount - 1;
+	taskQueue_s *queue = &pool->queues[queueIdx];
+	queue->mutex.lock();
+	queue->tasks.push_back(task);
+	pool->queuedCount++;
+	queue->mutex.unlock();
+
+	pool->sleepMutex.lock();
+	pool->sleepMutex.unlock();
+	pool->workCond.notify_one();
+	pool->doneCond.notify_all();
+}
+
+static poolTask_s *TakeTask(threadPool_s *pool, int ownQueueIdx) //Takes newest task from own queue, or steals the oldest task from another queue
+{
+	if(pool->queuedCount.load() == 0)
+		return 0;
+	for(int i = 0; i < pool->queueCount; i++)
+	{
+		int queueIdx = (ownQueueIdx + i) % pool->queueCount;
+		taskQueue_s *queue = &pool->queues[queueIdx];
+		queue->mutex.lock();
+		if(!queue->tasks.empty())
+		{
+			poolTask_s *task;
+			if(i == 0)
+			{
+				task = queue->tasks.back();
+				queue->tasks.pop_back();
+			}
+			else
+			{
+				task = queue->tasks.front();
+				queue->tasks.pop_front();
+			}
+			pool->queuedCount--;
+			queue->mutex.unlock();
+			return task;
+		}
+		queue->mutex.unlock();
+	}
+	return 0;
+}
+
+static void DereferenceTask(poolTask_s *task)
+{
+	if(--task->refCount == 0)
+		delete task;
+}
+
+static void RunTask(threadPool_s *pool, poolTask_s *task)
+{
+	task->func(task->param);
+
+	//Release tasks that were waiting for this one
+	task->mutex.lock();
+	task->finished = 1;
+	std::vector<poolTask_s*> dependents;
+	dependents.swap(task->dependents);
+	task->mutex.unlock();
+	for(size_t i = 0; i < dependents.size(); i++)
+	{
+		if(--dependents[i]->pendingCount == 0)
+			QueueTask(pool, dependents[i]);
+	}
+	DereferenceTask(task);
+
+	if(--pool->unfinishedCount == 0 || pool->waitingCount.load() > 0)
+	{
+		pool->sleepMutex.lock();
+		pool->sleepMutex.unlock();
+		pool->doneCond.notify_all();
+	}
+}
+
+static void WorkerThread(threadPool_s *pool, int queueIdx)
+{
+	currentPool = pool;
+	currentQueue = queueIdx;
+	while(1)
+	{
+		poolTask_s *task = TakeTask(pool, queueIdx);
+		if(task)
+		{
+			RunTask(pool, task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(pool->sleepMutex);
+		pool->workCond.wait(lock, [pool] { return pool->quit || pool->queuedCount.load() > 0; });
+		if(pool->quit)
+			break;
+	}
+}
+
+threadPool_s *ThreadPool_Create(int threadCount)
+{
+	if(threadCount <= 0)
+		threadCount = (int) std::thread::hardware_concurrency();
+	if(threadCount <= 0)
+		threadCount = 1;
+
+	threadPool_s *pool = new threadPool_s;
+	pool->queueCount = threadCount + 1;
+	pool->queues = new taskQueue_s[pool->queueCount];
+	pool->queuedCount = 0;
+	pool->unfinishedCount = 0;
+	pool->waitingCount = 0;
+	pool->quit = 0;
+	for(int i = 0; i < threadCount; i++)
+		pool->threads.push_back(std::thread(WorkerThread, pool, i));
+	return pool;
+}
+
+void ThreadPool_Destroy(threadPool_s *pool)
+{
+	ThreadPool_Wait(pool);
+	pool->sleepMutex.lock();
+	pool->quit = 1;
+	pool->sleepMutex.unlock();
+	pool->workCond.notify_all();
+	for(size_t i = 0; i < pool->threads.size(); i++)
+		pool->threads[i].join();
+	delete[]pool->queues;
+	delete pool;
+}
+
+int ThreadPool_ThreadCount(threadPool_s *pool)
+{
+	return (int) pool->threads.size();
+}
+
+poolTask_s *ThreadPool_CreateTask(threadPool_s *pool, poolTaskFunc_t func, void *param)
+{
+	poolTask_s *task = new poolTask_s;
+	task->pool = pool;
+	task->func = func;
+	task->param = param;
+	task->pendingCount = 1;
+	task->finished = 0;
+	task->refCount = 2;
+	return task;
+}
+
+void ThreadPool_ReleaseTask(poolTask_s *task)
+{
+	DereferenceTask(task);
+}
+
+bool ThreadPool_AddDependency(poolTask_s *task, poolTask_s *dependency)
+{
+	if(task->pool != dependency->pool) //Dependents are queued on the pool the dependency finishes in
+		return 0;
+	dependency->mutex.lock();
+	if(!dependency->finished)
+	{
+		task->pendingCount++;
+		dependency->dependents.push_back(task);
+	}
+	dependency->mutex.unlock();
+	return 1;
+}
+
+bool ThreadPool_Submit(threadPool_s *pool, poolTask_s *task)
+{
+	if(task->pool != pool)
+		return 0;
+	pool->unfinishedCount++;
+	if(--task->pendingCount == 0)
+		QueueTask(pool, task);
+	return 1;
+}
+
+static bool IsTaskFinished(poolTask_s *task)
+{
+	task->mutex.lock();
+	bool finished = task->finished;
+	task->mutex.unlock();
+	return finished;
+}
+
+void ThreadPool_WaitForTask(threadPool_s *pool, poolTask_s *task)
+{
+	int ownQueueIdx = currentPool == pool ? currentQueue : pool->queueCount - 1;
+	while(!IsTaskFinished(task))
+	{
+		poolTask_s *otherTask = TakeTask(pool, ownQueueIdx);
+		if(otherTask)
+		{
+			RunTask(pool, otherTask);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(pool->sleepMutex);
+		pool->waitingCount++;
+		pool->doneCond.wait(lock, [pool, task] { return IsTaskFinished(task) || pool->queuedCount.load() > 0; });
+		pool->waitingCount--;
+	}
+}
+
+void ThreadPool_Wait(threadPool_s *pool)
+{
+	int ownQueueIdx = currentPool == pool ? currentQueue : pool->queueCount - 1;
+	while(pool->unfinishedCount.load() > 0)
+	{
+		poolTask_s *task = TakeTask(pool, ownQueueIdx);
+		if(task)
+		{
+			RunTask(pool, task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(pool->sleepMutex);
+		pool->doneCond.wait(lock, [pool] { return pool->unfinishedCount.load() == 0 || pool->queuedCount.load() > 0; });
+	}
+}
@@ -0,0 +1,32 @@
+/*
+Copyright (C) 2023 FluffyQuack
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+struct threadPool_s; //Work-stealing thread pool. Every worker has its own task queue and steals from the other queues when it runs out of work
+struct poolTask_s;
+typedef void (*poolTaskFunc_t)(void *param);
+
+threadPool_s *ThreadPool_Create(int threadCount = 0); //0 or less means one worker per hardware thread
+void ThreadPool_Destroy(threadPool_s *pool);
+int ThreadPool_ThreadCount(threadPool_s *pool);
+poolTask_s *ThreadPool_CreateTask(threadPool_s *pool, poolTaskFunc_t func, void *param); //Task doesn't run until it's submitted. The returned handle has to be released with ThreadPool_ReleaseTask()
+void ThreadPool_ReleaseTask(poolTask_s *task); //Caller won't use the handle again. The task is freed once it has also finished, so this can be called right after submitting it
+bool ThreadPool_AddDependency(poolTask_s *task, poolTask_s *dependency); //Task won't start before dependency has finished. Has to be called before task is submitted. Fails if the tasks were created for different pools
+bool ThreadPool_Submit(threadPool_s *pool, poolTask_s *task); //Fails if the task was created for another pool
+void ThreadPool_WaitForTask(threadPool_s *pool, poolTask_s *task); //Runs other tasks on the calling thread until task has finished. Can be called from within a task
+void ThreadPool_Wait(threadPool_s *pool); //Runs tasks on the calling thread until every submitted task has finished. Don't call this from within a task
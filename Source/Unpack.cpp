@@ -0,0 +1,313 @@
+/*
+Copyright (C) 2023 FluffyQuack
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include "Unpack.h"
+
+//Pixels are packed with the first pixel in the highest bits of a byte. Every kernel here has to give the same result as conv_to_8bpp() in DAT-Formats.cpp, which is the reference.
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define UNPACK_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define UNPACK_TARGET_AVX2 //MSVC lets us use AVX2 intrinsics in any function
+#else
+#define UNPACK_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__) || defined(__ARM_NEON)
+#define UNPACK_NEON
+#include <arm_neon.h>
+#endif
+
+static int Unpack8_Copy(unsigned char *out, const unsigned char *in, int byteCount)
+{
+	memcpy(out, in, byteCount);
+	return byteCount;
+}
+
+static bool Expand_Scalar(unsigned char *out, const unsigned char *in, int pixelCount, const unsigned int *lookup) //SSE2 and NEON have no gather, so a plain lookup with 32-bit stores is the best they can do
+{
+	int foundZero = 0;
+	for(int i = 0; i < pixelCount; i++)
+	{
+		memcpy(&out[i * 4], &lookup[in[i]], 4);
+		foundZero |= in[i] == 0;
+	}
+	return foundZero != 0;
+}
+
+#ifdef UNPACK_X86
+static int Unpack4_SSE2(unsigned char *out, const unsigned char *in, int byteCount) //16 bytes to 32 pixels
+{
+	const __m128i lowMask = _mm_set1_epi8(0x0F);
+	int pos = 0;
+	for(; pos + 16 <= byteCount; pos += 16, out += 32)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *) &in[pos]);
+		__m128i high = _mm_and_si128(_mm_srli_epi16(v, 4), lowMask);
+		__m128i low = _mm_and_si128(v, lowMask);
+		_mm_storeu_si128((__m128i *) &out[0], _mm_unpacklo_epi8(high, low));
+		_mm_storeu_si128((__m128i *) &out[16], _mm_unpackhi_epi8(high, low));
+	}
+	return pos;
+}
+
+static int Unpack2_SSE2(unsigned char *out, const unsigned char *in, int byteCount) //16 bytes to 64 pixels
+{
+	const __m128i mask = _mm_set1_epi8(0x03);
+	int pos = 0;
+	for(; pos + 16 <= byteCount; pos += 16, out += 64)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *) &in[pos]);
+		__m128i p0 = _mm_and_si128(_mm_srli_epi16(v, 6), mask);
+		__m128i p1 = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+		__m128i p2 = _mm_and_si128(_mm_srli_epi16(v, 2), mask);
+		__m128i p3 = _mm_and_si128(v, mask);
+		__m128i p01Low = _mm_unpacklo_epi8(p0, p1), p01High = _mm_unpackhi_epi8(p0, p1);
+		__m128i p23Low = _mm_unpacklo_epi8(p2, p3), p23High = _mm_unpackhi_epi8(p2, p3);
+		_mm_storeu_si128((__m128i *) &out[0], _mm_unpacklo_epi16(p01Low, p23Low));
+		_mm_storeu_si128((__m128i *) &out[16], _mm_unpackhi_epi16(p01Low, p23Low));
+		_mm_storeu_si128((__m128i *) &out[32], _mm_unpacklo_epi16(p01High, p23High));
+		_mm_storeu_si128((__m128i *) &out[48], _mm_unpackhi_epi16(p01High, p23High));
+	}
+	return pos;
+}
+
+static inline void StoreBits_SSE2(unsigned char *out, __m128i twoBytes, __m128i bitMask, __m128i one) //twoBytes holds two input bytes repeated 8 times each
+{
+	_mm_storeu_si128((__m128i *) out, _mm_min_epu8(_mm_and_si128(twoBytes, bitMask), one));
+}
+
+static int Unpack1_SSE2(unsigned char *out, const unsigned char *in, int byteCount) //16 bytes to 128 pixels
+{
+	const __m128i bitMask = _mm_set_epi8(1, 2, 4, 8, 16, 32, 64, (char) 128, 1, 2, 4, 8, 16, 32, 64, (char) 128);
+	const __m128i one = _mm_set1_epi8(1);
+	int pos = 0;
+	for(; pos + 16 <= byteCount; pos += 16, out += 128)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *) &in[pos]);
+		__m128i x2Low = _mm_unpacklo_epi8(v, v), x2High = _mm_unpackhi_epi8(v, v); //Every byte twice
+		__m128i x4[4] = {_mm_unpacklo_epi16(x2Low, x2Low), _mm_unpackhi_epi16(x2Low, x2Low), _mm_unpacklo_epi16(x2High, x2High), _mm_unpackhi_epi16(x2High, x2High)}; //Every byte four times
+		for(int i = 0; i < 4; i++)
+		{
+			StoreBits_SSE2(&out[i * 32], _mm_unpacklo_epi32(x4[i], x4[i]), bitMask, one);
+			StoreBits_SSE2(&out[i * 32 + 16], _mm_unpackhi_epi32(x4[i], x4[i]), bitMask, one);
+		}
+	}
+	return pos;
+}
+
+UNPACK_TARGET_AVX2 static int Unpack4_AVX2(unsigned char *out, const unsigned char *in, int byteCount) //16 bytes to 32 pixels
+{
+	const __m256i lowMask = _mm256_set1_epi16(0x0F);
+	int pos = 0;
+	for(; pos + 16 <= byteCount; pos += 16, out += 32)
+	{
+		__m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) &in[pos])); //One input byte per 16-bit lane
+		__m256i pixels = _mm256_or_si256(_mm256_srli_epi16(v, 4), _mm256_slli_epi16(_mm256_and_si256(v, lowMask), 8)); //High nibble goes in the first byte of the lane
+		_mm256_storeu_si256((__m256i *) out, pixels);
+	}
+	return pos;
+}
+
+UNPACK_TARGET_AVX2 static int Unpack2_AVX2(unsigned char *out, const unsigned char *in, int byteCount) //8 bytes to 32 pixels
+{
+	const __m256i mask = _mm256_set1_epi32(0x03);
+	int pos = 0;
+	for(; pos + 8 <= byteCount; pos += 8, out += 32)
+	{
+		__m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) &in[pos])); //One input byte per 32-bit lane
+		__m256i pixels = _mm256_and_si256(_mm256_srli_epi32(v, 6), mask);
+		pixels = _mm256_or_si256(pixels, _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(v, 4), mask), 8));
+		pixels = _mm256_or_si256(pixels, _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(v, 2), mask), 16));
+		pixels = _mm256_or_si256(pixels, _mm256_slli_epi32(_mm256_and_si256(v, mask), 24));
+		_mm256_storeu_si256((__m256i *) out, pixels);
+	}
+	return pos;
+}
+
+UNPACK_TARGET_AVX2 static int Unpack1_AVX2(unsigned char *out, const unsigned char *in, int byteCount) //4 bytes to 32 pixels
+{
+	const __m256i spread = _mm256_set_epi8(3, 3, 3, 3, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0); //Shuffle that repeats every input byte 8 times
+	const __m256i bitMask = _mm256_set1_epi64x(0x0102040810204080LL);
+	const __m256i one = _mm256_set1_epi8(1);
+	int pos = 0;
+	for(; pos + 4 <= byteCount; pos += 4, out += 32)
+	{
+		int bytes;
+		memcpy(&bytes, &in[pos], 4);
+		__m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32(bytes), spread);
+		_mm256_storeu_si256((__m256i *) out, _mm256_min_epu8(_mm256_and_si256(v, bitMask), one));
+	}
+	return pos;
+}
+
+UNPACK_TARGET_AVX2 static bool Expand_AVX2(unsigned char *out, const unsigned char *in, int pixelCount, const unsigned int *lookup) //8 pixels at a time with a gather
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i foundZero = zero;
+	int i = 0;
+	for(; i + 8 <= pixelCount; i += 8)
+	{
+		__m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) &in[i]));
+		_mm256_storeu_si256((__m256i *) &out[i * 4], _mm256_i32gather_epi32((const int *) lookup, indices, 4));
+		foundZero = _mm256_or_si256(foundZero, _mm256_cmpeq_epi32(indices, zero));
+	}
+	bool tailFoundZero = Expand_Scalar(&out[i * 4], &in[i], pixelCount - i, lookup);
+	return _mm256_movemask_epi8(foundZero) != 0 || tailFoundZero;
+}
+
+static bool CPUSupportsAVX2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if(info[0] < 7)
+		return 0;
+	__cpuid(info, 1);
+	if((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) //OSXSAVE and AVX
+		return 0;
+	if((_xgetbv(0) & 6) != 6) //OS saves YMM registers
+		return 0;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+#ifdef UNPACK_NEON
+static int Unpack4_NEON(unsigned char *out, const unsigned char *in, int byteCount) //16 bytes to 32 pixels
+{
+	int pos = 0;
+	for(; pos + 16 <= byteCount; pos += 16, out += 32)
+	{
+		uint8x16_t v = vld1q_u8(&in[pos]);
+		uint8x16x2_t pixels;
+		pixels.val[0] = vshrq_n_u8(v, 4);
+		pixels.val[1] = vandq_u8(v, vdupq_n_u8(0x0F));
+		vst2q_u8(out, pixels); //Interleaves the two registers as it stores them
+	}
+	return pos;
+}
+
+static int Unpack2_NEON(unsigned char *out, const unsigned char *in, int byteCount) //16 bytes to 64 pixels
+{
+	const uint8x16_t mask = vdupq_n_u8(0x03);
+	int pos = 0;
+	for(; pos + 16 <= byteCount; pos += 16, out += 64)
+	{
+		uint8x16_t v = vld1q_u8(&in[pos]);
+		uint8x16x4_t pixels;
+		pixels.val[0] = vshrq_n_u8(v, 6);
+		pixels.val[1] = vandq_u8(vshrq_n_u8(v, 4), mask);
+		pixels.val[2] = vandq_u8(vshrq_n_u8(v, 2), mask);
+		pixels.val[3] = vandq_u8(v, mask);
+		vst4q_u8(out, pixels);
+	}
+	return pos;
+}
+
+static int Unpack1_NEON(unsigned char *out, const unsigned char *in, int byteCount) //16 bytes to 128 pixels
+{
+	const uint8x16_t bitMask = vreinterpretq_u8_u64(vdupq_n_u64(0x0102040810204080ULL));
+	const uint8x16_t one = vdupq_n_u8(1);
+	int pos = 0;
+	for(; pos + 16 <= byteCount; pos += 16, out += 128)
+	{
+		uint8x16_t v = vld1q_u8(&in[pos]);
+		uint8x16x2_t x2 = vzipq_u8(v, v); //Every byte twice
+		for(int i = 0; i < 2; i++)
+		{
+			uint16x8x2_t x4 = vzipq_u16(vreinterpretq_u16_u8(x2.val[i]), vreinterpretq_u16_u8(x2.val[i])); //Every byte four times
+			for(int j = 0; j < 2; j++)
+			{
+				uint32x4x2_t x8 = vzipq_u32(vreinterpretq_u32_u16(x4.val[j]), vreinterpretq_u32_u16(x4.val[j])); //Every byte eight times
+				vst1q_u8(&out[i * 64 + j * 32], vminq_u8(vandq_u8(vreinterpretq_u8_u32(x8.val[0]), bitMask), one));
+				vst1q_u8(&out[i * 64 + j * 32 + 16], vminq_u8(vandq_u8(vreinterpretq_u8_u32(x8.val[1]), bitMask), one));
+			}
+		}
+	}
+	return pos;
+}
+#endif
+
+struct unpackKernels_s
+{
+	unpackKernel_t depth1;
+	unpackKernel_t depth2;
+	unpackKernel_t depth4;
+	expandKernel_t expand;
+	const char *name;
+};
+
+static unpackKernels_s SelectUnpackKernels()
+{
+	unpackKernels_s kernels = {0, 0, 0, Expand_Scalar, "scalar"};
+#if defined(UNPACK_X86)
+	if(CPUSupportsAVX2())
+	{
+		kernels.depth1 = Unpack1_AVX2;
+		kernels.depth2 = Unpack2_AVX2;
+		kernels.depth4 = Unpack4_AVX2;
+		kernels.expand = Expand_AVX2;
+		kernels.name = "AVX2";
+	}
+	else //Every x64 CPU has SSE2, and MSVC assumes it for x86 as well
+	{
+		kernels.depth1 = Unpack1_SSE2;
+		kernels.depth2 = Unpack2_SSE2;
+		kernels.depth4 = Unpack4_SSE2;
+		kernels.name = "SSE2";
+	}
+#elif defined(UNPACK_NEON)
+	kernels.depth1 = Unpack1_NEON;
+	kernels.depth2 = Unpack2_NEON;
+	kernels.depth4 = Unpack4_NEON;
+	kernels.name = "NEON";
+#endif
+	return kernels;
+}
+
+static const unpackKernels_s *Kernels()
+{
+	static const unpackKernels_s kernels = SelectUnpackKernels(); //Only detected once
+	return &kernels;
+}
+
+unpackKernel_t Prince_UnpackKernel(int depth)
+{
+	if(depth == 1) return Kernels()->depth1;
+	if(depth == 2) return Kernels()->depth2;
+	if(depth == 4) return Kernels()->depth4;
+	if(depth == 8) return Unpack8_Copy;
+	return 0;
+}
+
+expandKernel_t Prince_ExpandKernel()
+{
+	return Kernels()->expand;
+}
+
+const char *Prince_UnpackKernelName()
+{
+	return Kernels()->name;
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+/*
+Copyright (C) 2023 FluffyQuack
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+typedef int (*unpackKernel_t)(unsigned char *out, const unsigned char *in, int byteCount); //Unpacks packed pixels to one byte per pixel in blocks. Returns how many input bytes were used, which can be less than byteCount if the rest doesn't fill a block
+typedef bool (*expandKernel_t)(unsigned char *out, const unsigned char *in, int pixelCount, const unsigned int *lookup); //Expands 8-bit palette indices to 4 bytes per pixel using a 256-entry lookup table. Returns 1 if any index was 0
+
+unpackKernel_t Prince_UnpackKernel(int depth); //Returns the fastest kernel the CPU supports for 1, 2, 4 or 8-bit pixels, or null if there's none for depth
+expandKernel_t Prince_ExpandKernel(); //Returns the fastest palette expansion kernel the CPU supports
+const char *Prince_UnpackKernelName(); //Instruction set of the kernels Prince_UnpackKernel() returns
\ No newline at end of file
@@ -109,9 +109,10 @@ struct princeColour_s
 	unsigned char b;
 };
 
-struct princeGenericPalette_s
+struct princePalette_s //Compiled palette that images are expanded with. Get one with Prince_ConvertPalette() or Prince_CompilePalette(). It never changes after it's built, so it can be shared by any number of threads
 {
-	princeColour_s colours[PRINCEMAXPALSIZE];
+	alignas(64) unsigned int rgba[256]; //First 256 colours as RGBA bytes (index 0 is transparent). Aligned so the table starts on a cache line
+	unsigned long long hash; //Hash of rgba, so palettes can be used in cache keys. Palettes with the same colours have the same hash
 };
 
 #pragma pack(push, 1)
@@ -129,14 +130,14 @@ struct datFooter_s
 struct datFooterEntry_s
 {
 	unsigned short id;
-	unsigned long offset; //Offset in the DAT where the entry's data starts (note: an entry's data starts with a checksum byte)
+	unsigned int offset; //Offset in the DAT where the entry's data starts (note: an entry's data starts with a checksum byte)
 	unsigned short size; //Size of the entry data in the DAT file (does not include checksum byte)
 };
 
 struct datFooterEntryV2_s
 {
 	unsigned short id;
-	unsigned long offset; //Offset in the DAT where the entry's data starts (note: an entry's data starts with a checksum byte)
+	unsigned int offset; //Offset in the DAT where the entry's data starts (note: an entry's data starts with a checksum byte)
 	unsigned short size; //Size of the entry data in the DAT file (does not include checksum byte)
 	unsigned char flags[3]; //Maybe flag values? I noticed first byte was 64 and the others were 00 for most of the "shape" entrys in KID.DAT
 };
@@ -151,4 +152,12 @@ struct datFooterHeader_s //Followed by POP2's "master index" we get definitions
 	char magic[4];
 	unsigned short footerOffset; //This offset counts from the position of masterIndex, not start of file
 };
-#pragma pack(pop)
\ No newline at end of file
+#pragma pack(pop)
+
+//These are read straight out of DAT files, so their layout can't depend on the compiler (unsigned int is 32-bit on every platform we build for, unlike unsigned long)
+static_assert(sizeof(datHeader_s) == 6, "datHeader_s must match the on-disk layout");
+static_assert(sizeof(datFooter_s) == 2, "datFooter_s must match the on-disk layout");
+static_assert(sizeof(datFooterEntry_s) == 8, "datFooterEntry_s must match the on-disk layout");
+static_assert(sizeof(datFooterEntryV2_s) == 11, "datFooterEntryV2_s must match the on-disk layout");
+static_assert(sizeof(datMasterIndex_s) == 2, "datMasterIndex_s must match the on-disk layout");
+static_assert(sizeof(datFooterHeader_s) == 6, "datFooterHeader_s must match the on-disk layout");
\ No newline at end of file
@@ -39,6 +39,10 @@ Rename this file to lodepng.cpp to use it for C++, or to lodepng.c to use it for
 #include <stdlib.h> /* allocations */
 #endif /* LODEPNG_COMPILE_ALLOCATORS */
 
+#if defined(LODEPNG_COMPILE_ZLIB) && defined(LODEPNG_COMPILE_ENCODER)
+#include <thread> /* parallel deflate */
+#endif
+
 #if defined(_MSC_VER) && (_MSC_VER >= 1310) /*Visual Studio: A few warning types are not desired here.*/
 #pragma warning( disable : 4244 ) /*implicit conversions: not warned by gcc -Wall -Wextra and requires too much casts*/
 #pragma warning( disable : 4996 ) /*VS does not like fopen, but fopen_s is not standard C so unusable here*/
@@ -2062,6 +2066,119 @@ static unsigned deflateFixed(LodePNGBitWriter* writer, Hash* hash,
     return error;
 }
 
+/*
+Parallel deflate, in the style of pigz. The data is split into one part per thread and the parts are compressed at
+the same time. Each part starts with its hash primed with the window before it, so matches can still reach back into
+the previous part, and every part but the last ends with an empty stored block so it ends on a byte boundary. That
+lets us join the parts as they are, and the result is one ordinary deflate stream.
+*/
+#define PARALLEL_DEFLATE_MINPART 131072 /*smaller parts aren't worth starting a thread for*/
+
+typedef struct DeflatePart {
+    ucvector out;
+    const unsigned char* in;
+    size_t start;
+    size_t end;
+    size_t blocksize;
+    unsigned final;
+    const LodePNGCompressSettings* settings;
+    unsigned error;
+} DeflatePart;
+
+/*adds the positions in the window before "end" to the hash, the same way encodeLZ77 would have*/
+static void hash_prime(Hash* hash, const unsigned char* in, size_t end, unsigned windowsize) {
+    size_t pos = end > windowsize ? end - windowsize : 0;
+    unsigned numzeros = 0;
+    for(; pos < end; ++pos) {
+        unsigned hashval = getHash(in, end, pos);
+        if(hashval == 0) {
+            if(numzeros == 0) numzeros = countZeros(in, end, pos);
+            else if(pos + numzeros > end || in[pos + numzeros - 1] != 0) --numzeros;
+        } else {
+            numzeros = 0;
+        }
+        updateHashChain(hash, pos & (windowsize - 1), hashval, numzeros);
+    }
+}
+
+static void deflatePart(DeflatePart* part) {
+    const LodePNGCompressSettings* settings = part->settings;
+    size_t start;
+    Hash hash;
+    LodePNGBitWriter writer;
+
+    LodePNGBitWriter_init(&writer, &part->out);
+    part->error = hash_init(&hash, settings->windowsize);
+    if(!part->error) {
+        hash_prime(&hash, part->in, part->start, settings->windowsize);
+        for(start = part->start; start < part->end && !part->error; start += part->blocksize) {
+            size_t end = part->end - start > part->blocksize ? start + part->blocksize : part->end;
+            unsigned final = part->final && end == part->end;
+            if(settings->btype == 1) part->error = deflateFixed(&writer, &hash, part->in, start, end, settings, final);
+            else part->error = deflateDynamic(&writer, &hash, part->in, start, end, settings, final);
+        }
+    }
+    if(!part->error && !part->final) {
+        /*empty stored block: 3 header bits, padding to the next byte, then LEN 0 and NLEN 0xffff*/
+        writeBits(&writer, 0, 3);
+        if(!ucvector_resize(&part->out, part->out.size + 4)) part->error = 83; /*alloc fail*/
+        else lodepng_memcpy(part->out.data + part->out.size - 4, "\0\0\377\377", 4);
+    }
+    hash_cleanup(&hash);
+}
+
+static unsigned deflateParallel(ucvector* out, const unsigned char* in, size_t insize, size_t blocksize,
+    const LodePNGCompressSettings* settings) {
+    unsigned error = 0;
+    size_t i, partsize, partcount = insize / PARALLEL_DEFLATE_MINPART;
+    DeflatePart* parts;
+    std::thread* threads;
+
+    if(partcount > settings->threads) partcount = settings->threads;
+    partsize = (insize + partcount - 1) / partcount;
+    parts = (DeflatePart*)lodepng_malloc(sizeof(DeflatePart) * partcount);
+    threads = new std::thread[partcount];
+    if(!parts) error = 83; /*alloc fail*/
+
+    if(!error) {
+        for(i = 0; i != partcount; ++i) {
+            parts[i].out = ucvector_init(NULL, 0);
+            parts[i].in = in;
+            parts[i].start = i * partsize;
+            parts[i].end = i == partcount - 1 ? insize : (i + 1) * partsize;
+            parts[i].blocksize = settings->btype == 1 ? parts[i].end - parts[i].start : blocksize;
+            parts[i].final = (i == partcount - 1);
+            parts[i].settings = settings;
+            parts[i].error = 0;
+        }
+
+        /*the calling thread does the first part*/
+        for(i = 1; i != partcount; ++i) {
+            try {
+                threads[i] = std::thread(deflatePart, &parts[i]);
+            } catch(...) {
+                deflatePart(&parts[i]); /*couldn't start a thread, so do it here instead*/
+            }
+        }
+        deflatePart(&parts[0]);
+        for(i = 1; i != partcount; ++i) {
+            if(threads[i].joinable()) threads[i].join();
+        }
+
+        for(i = 0; i != partcount; ++i) {
+            size_t pos = out->size;
+            if(!error) error = parts[i].error;
+            if(!error && !ucvector_resize(out, out->size + parts[i].out.size)) error = 83; /*alloc fail*/
+            if(!error) lodepng_memcpy(out->data + pos, parts[i].out.data, parts[i].out.size);
+            lodepng_free(parts[i].out.data);
+        }
+    }
+
+    delete[] threads;
+    lodepng_free(parts);
+    return error;
+}
+
 static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
     const LodePNGCompressSettings* settings) {
     unsigned error = 0;
@@ -2081,6 +2198,10 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
         if(blocksize > 262144) blocksize = 262144;
     }
 
+    if(settings->threads > 1 && insize >= 2 * PARALLEL_DEFLATE_MINPART) {
+        return deflateParallel(out, in, insize, blocksize, settings);
+    }
+
     numdeflateblocks = (insize + blocksize - 1) / blocksize;
     if(numdeflateblocks == 0) numdeflateblocks = 1;
 
@@ -2329,13 +2450,14 @@ void lodepng_compress_settings_init(LodePNGCompressSettings* settings) {
     settings->minmatch = 3;
     settings->nicematch = 128;
     settings->lazymatching = 1;
+    settings->threads = 1;
 
     settings->custom_zlib = 0;
     settings->custom_deflate = 0;
     settings->custom_context = 0;
 }
 
-const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0};
+const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 1, 0, 0, 0};
 
 
 #endif /*LODEPNG_COMPILE_ENCODER*/
@@ -334,6 +334,7 @@ struct LodePNGCompressSettings /*deflate = compress*/ {
     unsigned minmatch; /*minimum lz77 length. 3 is normally best, 6 can be better for some PNGs. Default: 0*/
     unsigned nicematch; /*stop searching if >= this length found. Set to 258 for best compression. Default: 128*/
     unsigned lazymatching; /*use lazy matching: better compression but a bit slower. Default: true*/
+    unsigned threads; /*compress large data as this many parts at the same time (pigz style). 0 or 1 uses only the calling thread. Default: 1*/
 
                            /*use custom zlib encoder instead of built in one (default: null)*/
     unsigned (*custom_zlib)(unsigned char**, size_t*,